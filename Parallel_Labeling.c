@@ -26,33 +26,72 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
    order to actually use omp. */
 
 #include <stdio.h>
-   /*#include <stddef.h>*/
+#include <stddef.h>
 #include <stdlib.h> 
 #include <omp.h>
 #include <errno.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
 
-   /* Define a C data type "SizeType" that is a signed integer with the same
-	  number of bits as a pointer: it is suitable for array indexing up to any
-	  size that fits in memory. The format string for "ptrdiff_t" is "%td". */
-typedef ptrdiff_t               SizeType;
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_X86_TARGETS /*Kernels for wider instruction sets can be compiled per function and picked at runtime.*/
+#endif
 
-/* Define the pixel data types of the source and destination images. */
-typedef unsigned char           srcPixelType;
-typedef unsigned short int      dstPixelType;
+#ifdef _MSC_VER
+#include <intrin.h>
+#define forceinline __forceinline
+#define fseek64 _fseeki64
+#define popcount64(x) ((SizeType)__popcnt64(x))
+#define ctz64(x) popcount64(((x) & (0 - (x))) - 1)
+#else
+#define forceinline inline __attribute__((always_inline)) /*For cores specialized by constant arguments, which must be inlined to be.*/
+#define fseek64 fseeko
+#define popcount64(x) ((SizeType)__builtin_popcountll(x))
+#define ctz64(x) ((SizeType)__builtin_ctzll(x))
+#endif
 
+#include "Parallel_Labeling.h"
+
+/* A stack of voxel indices or labels. When it cannot grow, failed is set
+   and the items pushed are dropped, so a flood fill still ends; whoever
+   filled the stack checks failed afterwards and resets it. */
 struct Stack {
 	SizeType *arr;
 	SizeType top, capacity, size;
+	int failed;
 };
 
+/* Return a new stack, or NULL when memory runs out. */
 struct Stack *createStack(SizeType capacity) {
 	struct Stack *s = (struct Stack *)malloc(sizeof(struct Stack));
+	if (s == NULL) return NULL;
 	s->arr = (SizeType *)malloc(sizeof(SizeType)*capacity);
+	if (s->arr == NULL) {
+		free(s);
+		return NULL;
+	}
 	s->top = -1;
 	s->capacity = capacity;
 	s->size = 0;
+	s->failed = 0;
 	return s;
 }
 
@@ -61,15 +100,17 @@ void destroyStack(struct Stack *s) {
 	free(s);
 }
 
-void doubleStack(struct Stack *s) {
-	s->capacity = s->capacity * 2;
-	s->arr = realloc(s->arr, sizeof(SizeType)*s->capacity);
-	if (s->arr != NULL) {
-		printf("Array doubling happened successfully!\n");
-	}
-	else {
-		perror("realloc");
+/* Double the capacity of s; return 0, setting failed, when memory runs out. */
+int doubleStack(struct Stack *s) {
+	SizeType capacity = s->capacity > 0 ? s->capacity * 2 : 16;
+	SizeType *arr = (SizeType *)realloc(s->arr, sizeof(SizeType)*capacity);
+	if (arr == NULL) {
+		s->failed = 1;
+		return 0;
 	}
+	s->arr = arr;
+	s->capacity = capacity;
+	return 1;
 }
 
 int isFull(struct Stack *s) {
@@ -77,8 +118,8 @@ int isFull(struct Stack *s) {
 }
 
 void push(struct Stack *s, SizeType item) {
-	if (isFull(s))
-		doubleStack(s);
+	if (isFull(s) && !doubleStack(s))
+		return;
 	s->arr[++(s->top)] = item;
 	s->size++;
 }
@@ -110,585 +151,6164 @@ SizeType pop(struct Stack *s) {
 #define FNAME "binaryImg_x1024_y1024_z20_obj14117.txt" /* VOLUME characters of ascii '0' and '1' */ 
 #define STACK_INITIAL_SIZE ((DIM_X + DIM_Y + DIM_Z)/10) /*This is the initial size of stack used for the DFS in the single-pass algorithm. 
 Ideally it approximates the size of the largests object in the image. TODO: choose better initial value.*/
+#define BLOCK_DIM_X ((SizeType)64) /*Block size of the block-based labeling engine. A block of 64*64*16 voxels holds at most */
+#define BLOCK_DIM_Y ((SizeType)64) /*32768 6-connected objects, so block-local labels always fit in dstPixelType.*/
+#define BLOCK_DIM_Z ((SizeType)16)
+#define ASCII_CHUNK_SIZE ((SizeType)1 << 22) /*Number of characters that readAsciiImg reads and converts as one piece of work.*/
+#define VOLUME_ALIGNMENT ((size_t)64) /*Alignment in bytes of the voxel data of a volume: one cache line.*/
+#define VOLUME_FILE_MAGIC "PLVOLUME" /*First eight bytes of a binary volume file.*/
+#define VOLUME_FILE_VERSION 1
+#define VOLUME_PACKING_NONE 0 /*One voxel per voxelType-sized element, no padding between rows.*/
+#define VOLUME_PACKING_BITS 1 /*Binary voxels, 64 per uint64_t word along X, voxel i in bit i % 64 of word i / 64 of its row. Each row starts a new word; unused bits are 0.*/
+#define GENERATOR_DENSITY 0.3116 /*Default object voxel probability of generated percolation volumes: the site percolation threshold of the cubic lattice.*/
+#define GENERATOR_SIZE ((SizeType)8) /*Default feature size of generated volumes: sphere and helix radius, spiral and lattice spacing.*/
+#define PAGE_REPORT_SAMPLES ((SizeType)4096) /*Largest number of pages per slab whose node reportPagePlacement queries.*/
+#define BENCH_TRIALS 5 /*Timed trials per engine and thread count of the benchmark, unless --trials is given.*/
+#define BENCH_WARMUP 1 /*Untimed runs before the trials, unless --warmup is given.*/
+#define BENCH_MAX_THREAD_COUNTS 32 /*Longest list of thread counts the benchmark sweeps.*/
+#define CHECK_EDIT_ROUNDS 8 /*Rounds of random voxel edits the checker relabels incrementally.*/
+
+/* A 3-D image stored in a single contiguous, VOLUME_ALIGNMENT-aligned block of
+   memory. Voxel (i, j, k) is element k * strideZ + j * strideY + i of data, so
+   that X changes the fastest and Z the slowest, like the 1-D layout of
+   example_advanced.c. Strides are counted in elements. A bit-packed binary
+   volume has packing VOLUME_PACKING_BITS and uint64_t elements, each holding
+   64 voxels of a row. A volume either owns its data, or views the data of a
+   mapped volume file, in which case mapping and mappingSize describe the
+   whole mapping. zeroed is set while the data is known to hold only zeros,
+   see allocateZeroedVolume; whatever writes the voxels clears it. */
+struct Volume {
+	void     *data;
+	SizeType  dimX, dimY, dimZ;
+	SizeType  strideY, strideZ;
+	size_t    elemSize;
+	int       packing;
+	int       zeroed;
+	void     *mapping;
+	size_t    mappingSize;
+};
 
+/* Header of a binary volume file. It is VOLUME_ALIGNMENT bytes long, so the
+   voxel data that directly follows it stays aligned when the file is mapped
+   at a page boundary. Voxels are stored X fastest, in native byte order. */
+struct VolumeFileHeader {
+	char      magic[8];
+	uint32_t  version;
+	uint32_t  voxelType;   /* Size of a voxel in bytes: 1, 2, 4 or 8. */
+	uint32_t  packing;
+	uint32_t  reserved0;
+	int64_t   dimX, dimY, dimZ;
+	int64_t   reserved[2];
+};
+
+/* Whether volumes are placed for NUMA machines: see firstTouchVolume. */
+static int numaFirstTouch = 0;
 
-/* Alocate memory for two 3-D arrays each with [DIM_Z][DIM_Y][DIM_X]
-   elements and the specified data types. Return the pointers to the
-   3-D arrays by reference (i.e. as yet another pointer to them). */
-void allocateImages(srcPixelType ****srcDataPtrPtrPtrPtr,
-	dstPixelType ****dstDataPtrPtrPtrPtr)
+/* Planes kMin up to kMax of slab t when dimZ planes are split into nSlabs
+   slabs of equal depth, the last one possibly thinner or empty. This is the
+   split of parallelSlabLabeling. */
+void getSlab(SizeType dimZ, SizeType nSlabs, SizeType t, SizeType *kMin, SizeType *kMax)
 {
-	SizeType        j, k;
-	srcPixelType   *src1D;
-	srcPixelType  **src2D;
-	srcPixelType ***src3D;
-	dstPixelType   *dst1D;
-	dstPixelType  **dst2D;
-	dstPixelType ***dst3D;
+	const SizeType depth = (dimZ + nSlabs - 1) / nSlabs;
 
-	src3D = (srcPixelType ***)malloc(DIM_Z * sizeof(srcPixelType **));
-	if (src3D == NULL) {
-		printf("Failed to in allocating source image. \n");
-		exit(1);
-	}
-	for (k = 0; k < DIM_Z; k++) {
-		src2D = (srcPixelType **)malloc(DIM_Y * sizeof(srcPixelType *));
-		if (src2D == NULL) {
-			printf("Failed to in allocating source image. \n");
-			exit(1);
-		}
+	*kMin = t * depth < dimZ ? t * depth : dimZ;
+	*kMax = (t + 1) * depth < dimZ ? (t + 1) * depth : dimZ;
+}
 
-		for (j = 0; j < DIM_Y; j++) {
-			src1D = (srcPixelType *)malloc(DIM_X * sizeof(srcPixelType));
-			if (src1D == NULL) {
-				printf("Failed to in allocating source image. \n");
-				exit(1);
-			}
+/* Zero vol with every thread writing its own slab of planes, so that on a
+   NUMA machine, where a page is placed on the node of the thread that first
+   touches it, each slab lies on the node of the thread that labels it in
+   parallelEdgeFirstSinglePassLabeling. The row loops of setDstToZero, setDstToSource and
+   process split the planes almost the same way. */
+void firstTouchVolume(struct Volume *vol)
+{
+#pragma omp parallel
+	{
+		SizeType kMin, kMax;
 
-			src2D[j] = src1D;
+		getSlab(vol->dimZ, omp_get_num_threads(), omp_get_thread_num(), &kMin, &kMax);
+		if (kMax > kMin) {
+			memset((char *)vol->data + kMin * vol->strideZ * vol->elemSize, 0, (size_t)((kMax - kMin) * vol->strideZ) * vol->elemSize);
 		}
-		src3D[k] = src2D;
 	}
+}
 
-	dst3D = (dstPixelType ***)malloc(DIM_Z * sizeof(dstPixelType **));
-	if (dst3D == NULL) {
-		printf("Failed to in allocating source image. \n");
-		exit(1);
-	}
-	for (k = 0; k < DIM_Z; k++) {
-		dst2D = (dstPixelType **)malloc(DIM_Y * sizeof(dstPixelType *));
-		if (dst2D == NULL) {
-			printf("Failed to in allocating destination image. \n");
-			exit(1);
-		}
-
-		for (j = 0; j < DIM_Y; j++) {
-			dst1D = (dstPixelType *)malloc(DIM_X * sizeof(dstPixelType));
-			if (dst1D == NULL) {
-				printf("Failed to in allocating destination image. \n");
-				exit(1);
-			}
+/* Allocate memory for a volume of dimX * dimY * dimZ elements of elemSize
+   bytes each, with one aligned allocation. With numaFirstTouch the pages are
+   placed by firstTouchVolume. Return 0, with vol->data NULL, when memory runs
+   out, and 1 otherwise; allocateVolume exits instead. */
+int tryAllocateVolume(struct Volume *vol, SizeType dimX, SizeType dimY, SizeType dimZ, size_t elemSize)
+{
+	size_t bytes = (size_t)(dimX * dimY * dimZ) * elemSize;
 
-			dst2D[j] = dst1D;
-		}
-		dst3D[k] = dst2D;
+	/* aligned_alloc wants the size to be a multiple of the alignment. */
+	bytes = (bytes + VOLUME_ALIGNMENT - 1) / VOLUME_ALIGNMENT * VOLUME_ALIGNMENT;
+#ifdef _MSC_VER
+	vol->data = _aligned_malloc(bytes, VOLUME_ALIGNMENT);
+#else
+	vol->data = aligned_alloc(VOLUME_ALIGNMENT, bytes);
+#endif
+	if (vol->data == NULL) return 0;
+	vol->dimX = dimX;
+	vol->dimY = dimY;
+	vol->dimZ = dimZ;
+	vol->strideY = dimX;
+	vol->strideZ = dimX * dimY;
+	vol->elemSize = elemSize;
+	vol->packing = VOLUME_PACKING_NONE;
+	vol->zeroed = 0;
+	vol->mapping = NULL;
+	vol->mappingSize = 0;
+	if (numaFirstTouch) {
+		firstTouchVolume(vol);
 	}
+	return 1;
+}
 
-	*srcDataPtrPtrPtrPtr = src3D;
-	*dstDataPtrPtrPtrPtr = dst3D;
+void allocateVolume(struct Volume *vol, SizeType dimX, SizeType dimY, SizeType dimZ, size_t elemSize)
+{
+	if (!tryAllocateVolume(vol, dimX, dimY, dimZ, elemSize)) {
+		printf("Failed to allocate %zu bytes of memory for a volume. \n", (size_t)(dimX * dimY * dimZ) * elemSize);
+		exit(1);
+	}
 }
 
-/* Read the source image into the source data array element by element,
-   convert ascii to binary. */
-void readSrcImg(srcPixelType ***srcData3D)
+/* allocateVolume for a volume whose voxels all start at 0, with zeroed set,
+   so that prepareFloodSource need not zero it. The memory is an anonymous
+   mapping, whose pages the system hands out zeroed when they are first
+   touched: there is no pass of its own to zero it, and every page is
+   faulted in by the thread that first writes it. With numaFirstTouch the
+   volume is placed and zeroed by firstTouchVolume instead. */
+void allocateZeroedVolume(struct Volume *vol, SizeType dimX, SizeType dimY, SizeType dimZ, size_t elemSize)
 {
-	SizeType  i, j, k;
-	FILE     *fp;
-	size_t    elemSize, elemCnt, elemRead;
+	const size_t bytes = (size_t)(dimX * dimY * dimZ) * elemSize;
+	void *mapping;
 
-	fp = fopen(FNAME, "rb");
-	if (fp == NULL) {
-		printf("Failed to open %s for reading. \n", FNAME);
+	if (numaFirstTouch || bytes == 0) {
+		allocateVolume(vol, dimX, dimY, dimZ, elemSize);
+		vol->zeroed = numaFirstTouch;
+		return;
+	}
+#ifdef _WIN32
+	{
+		HANDLE fileMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32),
+			(DWORD)bytes, NULL);
+		mapping = fileMapping == NULL ? NULL : MapViewOfFile(fileMapping, FILE_MAP_WRITE, 0, 0, 0);
+		if (fileMapping != NULL) CloseHandle(fileMapping);
+	}
+#else
+	mapping = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) mapping = NULL;
+#endif
+	if (mapping == NULL) {
+		printf("Failed to allocate %zu bytes of memory for a volume. \n", bytes);
 		exit(1);
 	}
+	vol->data = mapping;
+	vol->dimX = dimX;
+	vol->dimY = dimY;
+	vol->dimZ = dimZ;
+	vol->strideY = dimX;
+	vol->strideZ = dimX * dimY;
+	vol->elemSize = elemSize;
+	vol->packing = VOLUME_PACKING_NONE;
+	vol->zeroed = 1;
+	vol->mapping = mapping;
+	vol->mappingSize = bytes;
+}
 
-	/* C library function to read data:
-	   size_t fread(void *ptr, size_t size, size_t nmemb, FILE *stream); */
+/* Number of words of a bit-packed row of dimX voxels. */
+SizeType packedRowWords(SizeType dimX)
+{
+	return (dimX + 63) / 64;
+}
 
-	elemSize = sizeof(srcPixelType);
-	elemCnt = 1;
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				elemRead = fread(&(srcData3D[k][j][i]), elemSize, elemCnt, fp);
-				if (elemRead != elemCnt) {
-					printf("Failed to read %zu bytes from %s.\n",
-						elemSize * elemCnt, FNAME);
-					printf("%s\n", strerror(errno));
-					printf("Press enter to exit...\n");
-					getchar();
-					exit(1);
-				}
-			}
-		}
-	}
-	fclose(fp);
+/* Number of elements that hold one row of voxels of a volume. */
+SizeType volumeRowLength(const struct Volume *vol)
+{
+	return vol->packing == VOLUME_PACKING_BITS ? packedRowWords(vol->dimX) : vol->dimX;
+}
 
-	/* Convert ASCII '0' and '1' into binary 0 and 1. */
-#pragma omp parallel for collapse(3) private(i,j)
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				switch (srcData3D[k][j][i]) {
-				case '0':
-					srcData3D[k][j][i] = 0;
-					break;
-				case '1':
-					srcData3D[k][j][i] = 1;
-					break;
-				default:
-					printf("Warning: character with ascii value %d "
-						"encountered at 3-D index %td, %td, %td "
-						"while expecting either %d or %d.\n",
-						srcData3D[k][j][i], i, j, k, '0', '1');
-					srcData3D[k][j][i] = 0;
-				}
-			}
+/* The first voxel from i on of a bit-packed row of n voxels whose bit is set,
+   or clear when set is 0; n when there is none. Whole words without such a
+   bit are skipped. */
+static inline SizeType nextPackedVoxel(const uint64_t *words, SizeType i, SizeType n, int set)
+{
+	while (i < n) {
+		const uint64_t w = (set ? words[i / 64] : ~words[i / 64]) >> (i % 64);
+		if (w != 0) {
+			i += ctz64(w);
+			return i < n ? i : n;
 		}
+		i += 64 - i % 64;
 	}
+	return n;
 }
 
-void process(srcPixelType ***srcData3D, dstPixelType ***dstData3D)
+/* Allocate memory for a bit-packed binary volume of dimX * dimY * dimZ
+   voxels, one eighth of the memory of a volume of srcPixelType. */
+void allocatePackedVolume(struct Volume *vol, SizeType dimX, SizeType dimY, SizeType dimZ)
 {
-	SizeType i, j, k;
-
-	/* Loop (in parallel) over the destination pixels, do the work that
-	   needs to be done for each destination pixel. Local variables
-	   declared inside an omp parallel for loop are local to each thread
-	   by default. */
-#pragma omp parallel for collapse(3) private(i,j) 
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				dstPixelType   result;
+	allocateVolume(vol, packedRowWords(dimX), dimY, dimZ, sizeof(uint64_t));
+	vol->dimX = dimX;
+	vol->packing = VOLUME_PACKING_BITS;
+}
 
-				result = 0;
-				if (i >= 1) {
-					if (srcData3D[k][j][i - 1] != 0) result++;
-				}
-				if (i < DIM_X - 1) {
-					if (srcData3D[k][j][i + 1] != 0) result++;
-				}
+void freeVolume(struct Volume *vol)
+{
+	if (vol->mapping != NULL) {
+#ifdef _WIN32
+		UnmapViewOfFile(vol->mapping);
+#else
+		munmap(vol->mapping, vol->mappingSize);
+#endif
+		vol->mapping = NULL;
+	}
+	else if (vol->data != NULL) {
+#ifdef _MSC_VER
+		_aligned_free(vol->data);
+#else
+		free(vol->data);
+#endif
+	}
+	else {
+		printf("Warning: volume data was NULL during free.\n");
+	}
+	vol->data = NULL;
+}
 
-				if (j >= 1) {
-					if (srcData3D[k][j - 1][i] != 0) result++;
-				}
-				if (j < DIM_Y - 1) {
-					if (srcData3D[k][j + 1][i] != 0) result++;
-				}
+/* Print, for the slabs of planes that firstTouchVolume gives each thread,
+   how many pages of vol lie on each NUMA node, so the placement can be
+   checked. At most PAGE_REPORT_SAMPLES pages, evenly spread, are queried per
+   slab. Pages that were never touched are counted as not present. */
+void reportPagePlacement(const struct Volume *vol, const char *name)
+{
+#ifdef __linux__
+	const SizeType pageSize = (SizeType)sysconf(_SC_PAGESIZE);
+	const SizeType nSlabs = omp_get_max_threads();
+	void **pages = (void **)malloc((size_t)PAGE_REPORT_SAMPLES * sizeof(void *));
+	int *status = (int *)malloc((size_t)PAGE_REPORT_SAMPLES * sizeof(int));
+	SizeType t;
 
-				if (k >= 1) {
-					if (srcData3D[k - 1][j][i] != 0) result++;
-				}
-				if (k < DIM_Z - 1) {
-					if (srcData3D[k + 1][j][i] != 0) result++;
-				}
+	if (pages == NULL || status == NULL) {
+		printf("Failed to allocate the page report. \n");
+		exit(1);
+	}
+	printf("Page placement of %s, pages per NUMA node:\n", name);
+	for (t = 0; t < nSlabs; t++) {
+		SizeType kMin, kMax, first, last, nPages, step, n;
+		SizeType nodeCount[8] = { 0 }, otherCount = 0, absentCount = 0;
 
-				/* Write result in a non-overlapping way between the
-				   threads. */
-				dstData3D[k][j][i] = result;
-			}
+		getSlab(vol->dimZ, nSlabs, t, &kMin, &kMax);
+		if (kMax <= kMin) continue;
+		first = ((SizeType)vol->data + kMin * vol->strideZ * (SizeType)vol->elemSize) / pageSize;
+		last = ((SizeType)vol->data + kMax * vol->strideZ * (SizeType)vol->elemSize - 1) / pageSize;
+		nPages = last - first + 1;
+		step = (nPages + PAGE_REPORT_SAMPLES - 1) / PAGE_REPORT_SAMPLES;
+		for (n = 0; n * step < nPages; n++) {
+			pages[n] = (void *)((first + n * step) * pageSize);
 		}
-	} /* End of OMP parallel for. */
+		if (syscall(SYS_move_pages, 0, (unsigned long)n, pages, NULL, status, 0) != 0) {
+			printf("The page report needs move_pages: %s\n", strerror(errno));
+			break;
+		}
+		while (n-- > 0) {
+			if (status[n] < 0) absentCount++;
+			else if (status[n] < 8) nodeCount[status[n]]++;
+			else otherCount++;
+		}
+		printf("  slab %td, planes %td to %td:", t, kMin, kMax - 1);
+		for (n = 0; n < 8; n++) {
+			if (nodeCount[n] > 0) printf(" node %td: %td", n, nodeCount[n]);
+		}
+		if (otherCount > 0) printf(" nodes 8 and up: %td", otherCount);
+		if (absentCount > 0) printf(" not present: %td", absentCount);
+		printf("\n");
+	}
+	free(status);
+	free(pages);
+#else
+	printf("The page placement report of %s needs Linux.\n", name);
+#endif
 }
 
-/*Set all the entries of dstData3D to zero*/
-void setDstToZero(dstPixelType ***dstData3D)
+/* Allocate the source and destination images of [DIM_Z][DIM_Y][DIM_X]
+   voxels with the specified data types, the destination zeroed, see
+   allocateZeroedVolume. */
+void allocateImages(struct Volume *srcVol, struct Volume *dstVol)
 {
-	SizeType i, j, k;
-#pragma omp parallel for collapse(3) private(i,j) 
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				dstData3D[k][j][i] = 0;
-			}
-		}
-	}
+	allocateVolume(srcVol, DIM_X, DIM_Y, DIM_Z, sizeof(srcPixelType));
+	allocateZeroedVolume(dstVol, DIM_X, DIM_Y, DIM_Z, sizeof(dstPixelType));
 }
 
-/*Set all the entries of dstData3D to those of srcData3D*/
-void setDstToSource(srcPixelType ***srcData3D, dstPixelType ***dstData3D)
+/* Convert n ascii '0' and '1' characters in buf into binary 0 and 1 in place,
+   16 at a time with SSE2 compares where available. Any other character
+   becomes 0; the number of such characters is returned, and the offset of
+   the first one is stored in *firstBad (-1 if there is none). */
+SizeType asciiToBinary(srcPixelType *buf, SizeType n, SizeType *firstBad)
 {
-	SizeType i, j, k;
-#pragma omp parallel for collapse(3) private(i,j) 
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				dstData3D[k][j][i] = srcData3D[k][j][i];
+	SizeType inx = 0, badCount = 0;
+
+	*firstBad = -1;
+#ifdef HAVE_SSE2
+	const __m128i zeroChar = _mm_set1_epi8('0');
+	const __m128i oneChar = _mm_set1_epi8('1');
+	const __m128i one = _mm_set1_epi8(1);
+	for (; inx + 16 <= n; inx += 16) {
+		__m128i chars = _mm_loadu_si128((const __m128i *)(buf + inx));
+		__m128i isOne = _mm_cmpeq_epi8(chars, oneChar);
+		__m128i isZero = _mm_cmpeq_epi8(chars, zeroChar);
+		int valid = _mm_movemask_epi8(_mm_or_si128(isOne, isZero));
+
+		_mm_storeu_si128((__m128i *)(buf + inx), _mm_and_si128(isOne, one));
+		if (valid != 0xFFFF) {
+			int bit;
+			for (bit = 0; bit < 16; bit++) {
+				if (!(valid >> bit & 1)) {
+					if (*firstBad < 0) *firstBad = inx + bit;
+					badCount++;
+				}
 			}
 		}
 	}
+#endif
+	for (; inx < n; inx++) {
+		switch (buf[inx]) {
+		case '0':
+			buf[inx] = 0;
+			break;
+		case '1':
+			buf[inx] = 1;
+			break;
+		default:
+			if (*firstBad < 0) *firstBad = inx;
+			badCount++;
+			buf[inx] = 0;
+		}
+	}
+	return badCount;
 }
 
-/* Function to provide some output based on the destination image. We
-   give a histogram of connections. */
-void someOutput(dstPixelType ***dstData3D)
+/* Pack a row of n ascii '0' and '1' characters into the bits of words, using
+   four SSE2 movemasks per word where available. Any other character becomes
+   a 0 bit and is counted as in asciiToBinary. */
+SizeType asciiToBits(const char *chars, SizeType n, uint64_t *words, SizeType *firstBad)
 {
-	SizeType sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
-	SizeType sum4 = 0, sum5 = 0, sum6 = 0;
-	SizeType i, j, k;
+	SizeType inx = 0, badCount = 0;
 
-	/* A reduction for the operator + and a variable will do the operation
-	   in parallel, yet OMP will make sure that the final result from all
-	   threads is accumulated into a single variable. */
-
-#pragma omp parallel for collapse(3) private(i,j) \
-    reduction(+:sum0) \
-    reduction(+:sum1) \
-    reduction(+:sum2) \
-    reduction(+:sum3) \
-    reduction(+:sum4) \
-    reduction(+:sum5) \
-    reduction(+:sum6) 
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				dstPixelType neighborCnt = dstData3D[k][j][i];
-				switch (neighborCnt) {
-				case 0:
-					sum0++;
-					break;
-				case 1:
-					sum1++;
-					break;
-				case 2:
-					sum2++;
-					break;
-				case 3:
-					sum3++;
-					break;
-				case 4:
-					sum4++;
-					break;
-				case 5:
-					sum5++;
-					break;
-				case 6:
-					sum6++;
-					break;
-				default:
-					printf("Warning: unexpected value %hu encountered at "
-						"index %td, %td, %td.\n", neighborCnt, i, j, k);
+	*firstBad = -1;
+#ifdef HAVE_SSE2
+	const __m128i zeroChar = _mm_set1_epi8('0');
+	const __m128i oneChar = _mm_set1_epi8('1');
+	for (; inx + 64 <= n; inx += 64) {
+		uint64_t ones = 0, valid = 0;
+		int part;
+		for (part = 0; part < 4; part++) {
+			__m128i c = _mm_loadu_si128((const __m128i *)(chars + inx + 16 * part));
+			__m128i isOne = _mm_cmpeq_epi8(c, oneChar);
+			__m128i isZero = _mm_cmpeq_epi8(c, zeroChar);
+			ones |= (uint64_t)(unsigned)_mm_movemask_epi8(isOne) << (16 * part);
+			valid |= (uint64_t)(unsigned)_mm_movemask_epi8(_mm_or_si128(isOne, isZero)) << (16 * part);
+		}
+		words[inx / 64] = ones;
+		if (valid != ~(uint64_t)0) {
+			int bit;
+			for (bit = 0; bit < 64; bit++) {
+				if (!(valid >> bit & 1)) {
+					if (*firstBad < 0) *firstBad = inx + bit;
+					badCount++;
 				}
 			}
 		}
-	} /* End of OMP parallel for. */
-
-	printf("The number of pixels having 0 neighbors is: %td.\n", sum0);
-	printf("The number of pixels having 1 neighbor  is: %td.\n", sum1);
-	printf("The number of pixels having 2 neighbors is: %td.\n", sum2);
-	printf("The number of pixels having 3 neighbors is: %td.\n", sum3);
-	printf("The number of pixels having 4 neighbors is: %td.\n", sum4);
-	printf("The number of pixels having 5 neighbors is: %td.\n", sum5);
-	printf("The number of pixels having 6 neighbors is: %td.\n", sum6);
-	printf("Total: %td. \n", sum0 + sum1 + sum2 + sum3 + sum4 + sum5 + sum6);
+	}
+#endif
+	for (; inx < n; inx++) {
+		if (inx % 64 == 0) words[inx / 64] = 0;
+		if (chars[inx] == '1') {
+			words[inx / 64] |= (uint64_t)1 << (inx % 64);
+		}
+		else if (chars[inx] != '0') {
+			if (*firstBad < 0) *firstBad = inx;
+			badCount++;
+		}
+	}
+	return badCount;
 }
 
-
-
-void allocateStack(struct Stack **iStackPtr, struct Stack **jStackPtr, struct Stack **kStackPtr)
+/* Report the outcome of reading an ascii image in parallel chunks: exit if
+   any chunk could not be read, and warn once about unexpected characters. */
+void reportAsciiImgErrors(const char *fname, const struct Volume *srcVol, SizeType failedChunks, SizeType badCount, SizeType firstBad)
 {
-	struct Stack *iStack = createStack(STACK_INITIAL_SIZE);
-	struct Stack *jStack = createStack(STACK_INITIAL_SIZE);
-	struct Stack *kStack = createStack(STACK_INITIAL_SIZE);
+	const SizeType dimX = srcVol->dimX, dimY = srcVol->dimY;
 
-	*iStackPtr = iStack;
-	*jStackPtr = jStack;
-	*kStackPtr = kStack;
+	if (failedChunks > 0) {
+		printf("Failed to read %td bytes from %s.\n", dimX * dimY * srcVol->dimZ, fname);
+		printf("Press enter to exit...\n");
+		getchar();
+		exit(1);
+	}
+	if (badCount > 0) {
+		printf("Warning: %td characters other than %d or %d encountered, "
+			"the first at 3-D index %td, %td, %td; they were read as 0.\n",
+			badCount, '0', '1', firstBad % dimX, (firstBad / dimX) % dimY, firstBad / (dimX * dimY));
+	}
 }
 
-void singlePassDFS(dstPixelType ***dstData3D, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *iStack, struct Stack *jStack, struct Stack *kStack)
+/* Read an ascii image straight into a bit-packed volume. Like readAsciiImg,
+   but each thread reads its chunk of rows into a buffer of its own and packs
+   the rows from there. */
+void readAsciiImgPacked(const char *fname, struct Volume *bitVol, SizeType rowsPerChunk)
 {
-	push(iStack, i);
-	push(jStack, j);
-	push(kStack, k);
-	while (getSize(iStack) > 0)
+	uint64_t *bitData = (uint64_t *)bitVol->data;
+	const SizeType dimX = bitVol->dimX, dimY = bitVol->dimY;
+	const SizeType nRows = bitVol->dimY * bitVol->dimZ;
+	const SizeType nChunks = (nRows + rowsPerChunk - 1) / rowsPerChunk;
+	SizeType chunk;
+	SizeType badCount = 0, firstBad = PTRDIFF_MAX, failedChunks = 0;
+
+#pragma omp parallel reduction(+:badCount) reduction(min:firstBad) reduction(+:failedChunks)
 	{
-		i = pop(iStack);
-		j = pop(jStack);
-		k = pop(kStack);
-		if (i >= 1) {
-			if (dstData3D[k][j][i - 1] == 1) //Voxel is object voxel and not yet labeled.
-			{
-				dstData3D[k][j][i - 1] = label;
-				push(iStack, i - 1);
-				push(jStack, j);
-				push(kStack, k);
-			}
-		}
-		if (i < DIM_X - 1) {
-			if (dstData3D[k][j][i + 1] == 1) //Voxel is object voxel and not yet labeled.
-			{
-				dstData3D[k][j][i + 1] = label;
-				push(iStack, i + 1);
-				push(jStack, j);
-				push(kStack, k);
-			}
-		}
+		FILE *fp = fopen(fname, "rb");
+		char *chars = (char *)malloc((size_t)(rowsPerChunk * dimX));
 
-		if (j >= 1) {
-			if (dstData3D[k][j - 1][i] == 1) //Voxel is object voxel and not yet labeled.
-			{
-				dstData3D[k][j - 1][i] = label;
-				push(iStack, i);
-				push(jStack, j - 1);
-				push(kStack, k);
-			}
-		}
-		if (j < DIM_Y - 1) {
-			if (dstData3D[k][j + 1][i] == 1) //Voxel is object voxel and not yet labeled.
-			{
-				dstData3D[k][j + 1][i] = label;
-				push(iStack, i);
-				push(jStack, j + 1);
-				push(kStack, k);
-			}
-		}
+#pragma omp for schedule(dynamic)
+		for (chunk = 0; chunk < nChunks; chunk++) {
+			const SizeType rowBegin = chunk * rowsPerChunk;
+			const SizeType rowEnd = rowBegin + rowsPerChunk < nRows ? rowBegin + rowsPerChunk : nRows;
+			const size_t elemCnt = (size_t)((rowEnd - rowBegin) * dimX);
+			SizeType row;
 
-		if (k >= 1) {
-			if (dstData3D[k - 1][j][i] == 1) //Voxel is object voxel and not yet labeled.
-			{
-				dstData3D[k - 1][j][i] = label;
-				push(iStack, i);
-				push(jStack, j);
-				push(kStack, k - 1);
+			if (fp == NULL || chars == NULL ||
+				fseek64(fp, (int64_t)rowBegin * dimX, SEEK_SET) != 0 ||
+				fread(chars, 1, elemCnt, fp) != elemCnt) {
+				failedChunks++;
+				continue;
 			}
-		}
-		if (k < DIM_Z - 1) {
-			if (dstData3D[k + 1][j][i] == 1) //Voxel is object voxel and not yet labeled.
-			{
-				dstData3D[k + 1][j][i] = label;
-				push(iStack, i);
-				push(jStack, j);
-				push(kStack, k + 1);
+			for (row = rowBegin; row < rowEnd; row++) {
+				uint64_t *words = bitData + (row / dimY) * bitVol->strideZ + (row % dimY) * bitVol->strideY;
+				SizeType bad, first;
+
+				bad = asciiToBits(chars + (row - rowBegin) * dimX, dimX, words, &first);
+				if (bad > 0) {
+					badCount += bad;
+					if (row * dimX + first < firstBad) firstBad = row * dimX + first;
+				}
 			}
 		}
+		free(chars);
+		if (fp != NULL) fclose(fp);
 	}
+
+	reportAsciiImgErrors(fname, bitVol, failedChunks, badCount, firstBad);
 }
 
-void singlePassLabeling(dstPixelType ***dstData3D, const SizeType kMin, const SizeType kMax, const dstPixelType labelStart, const dstPixelType labelStep)
+/* Read an image of ascii '0' and '1' characters into the source data array
+   and convert ascii to binary, or to bits for a bit-packed volume. The file is split into chunks of whole rows
+   that the threads read and convert in parallel, each through its own file
+   handle. Unexpected characters are read as 0 and reported once at the end. */
+void readAsciiImg(const char *fname, struct Volume *srcVol)
 {
-	struct Stack   *iStack;
-	struct Stack   *jStack;
-	struct Stack   *kStack;
-	allocateStack(&iStack, &jStack, &kStack);
+	srcPixelType *srcData = (srcPixelType *)srcVol->data;
+	const SizeType dimX = srcVol->dimX, dimY = srcVol->dimY;
+	const SizeType nRows = srcVol->dimY * srcVol->dimZ;
+	const int dense = srcVol->strideY == dimX && srcVol->strideZ == dimX * dimY;
+	SizeType rowsPerChunk, nChunks, chunk;
+	SizeType badCount = 0, firstBad = PTRDIFF_MAX, failedChunks = 0;
 
-	SizeType i, j, k;
-	dstPixelType label = labelStart;
-	dstPixelType objectCount = 0;
-	for (k = kMin; k < kMax; k++)
+	rowsPerChunk = ASCII_CHUNK_SIZE / dimX > 0 ? ASCII_CHUNK_SIZE / dimX : 1;
+	nChunks = (nRows + rowsPerChunk - 1) / rowsPerChunk;
+
+	if (srcVol->packing == VOLUME_PACKING_BITS) {
+		readAsciiImgPacked(fname, srcVol, rowsPerChunk);
+		return;
+	}
+
+#pragma omp parallel reduction(+:badCount) reduction(min:firstBad) reduction(+:failedChunks)
 	{
-		for (j = 0; j < DIM_Y; j++) {
-			for (i = 0; i < DIM_X; i++) {
-				if (dstData3D[k][j][i] == 1)
-				{
-					dstData3D[k][j][i] = label;
-					singlePassDFS(dstData3D, i, j, k, label, iStack, jStack, kStack);
-					label += labelStep;
-					objectCount++;
+		FILE *fp = fopen(fname, "rb");
+
+#pragma omp for schedule(dynamic)
+		for (chunk = 0; chunk < nChunks; chunk++) {
+			const SizeType rowEnd = (chunk + 1) * rowsPerChunk < nRows ? (chunk + 1) * rowsPerChunk : nRows;
+			/* Rows of a dense volume are adjacent in memory as in the file,
+			   so the whole chunk is read with a single fread. */
+			const SizeType rowsPerRead = dense ? rowsPerChunk : 1;
+			SizeType row;
+
+			if (fp == NULL) {
+				failedChunks++;
+				continue;
+			}
+			for (row = chunk * rowsPerChunk; row < rowEnd; row += rowsPerRead) {
+				SizeType rowCnt = rowEnd - row < rowsPerRead ? rowEnd - row : rowsPerRead;
+				srcPixelType *dst = srcData + (row / dimY) * srcVol->strideZ + (row % dimY) * srcVol->strideY;
+				size_t elemCnt = (size_t)(rowCnt * dimX);
+				SizeType bad, first;
+
+				if (fseek64(fp, (int64_t)row * dimX, SEEK_SET) != 0 ||
+					fread(dst, sizeof(srcPixelType), elemCnt, fp) != elemCnt) {
+					failedChunks++;
+					break;
+				}
+				bad = asciiToBinary(dst, (SizeType)elemCnt, &first);
+				if (bad > 0) {
+					badCount += bad;
+					if (row * dimX + first < firstBad) firstBad = row * dimX + first;
 				}
 			}
 		}
+		if (fp != NULL) fclose(fp);
 	}
-	printf("Number of objects found in current subimage: %i\n", objectCount);
-	destroyStack(iStack);
-	destroyStack(jStack);
-	destroyStack(kStack);
+
+	reportAsciiImgErrors(fname, srcVol, failedChunks, badCount, firstBad);
 }
 
-void singlePassLabelingDefault(dstPixelType ***dstData3D)
+/* Read the source image FNAME. */
+void readSrcImg(struct Volume *srcVol)
 {
-	singlePassLabeling(dstData3D, 0, DIM_Z, 2, 1);
+	readAsciiImg(FNAME, srcVol);
 }
 
-void parallelEdgeFirstSinglePassLabeling(dstPixelType ***dstData3D)
+/* Write the header of a volume file of dimX * dimY * dimZ voxels of voxelSize
+   bytes to fp. */
+void writeVolumeHeader(FILE *fp, const char *fname, SizeType dimX, SizeType dimY, SizeType dimZ, size_t voxelSize, int packing)
 {
-	struct Stack   *iStack;
-	struct Stack   *jStack;
-	struct Stack   *kStack;
-	allocateStack(&iStack, &jStack, &kStack);
+	struct VolumeFileHeader header;
 
-	SizeType i, j;
-	dstPixelType label = 2;
-	SizeType kMid = DIM_Z / 2;
-	for (j = 0; j < DIM_Y; j++) {
-		for (i = 0; i < DIM_X; i++) {
-			if (dstData3D[kMid][j][i] == 1)
-			{
-				dstData3D[kMid][j][i] = label;
-				singlePassDFS(dstData3D, i, j, kMid, label, iStack, jStack, kStack);
-				label++;
-			}
-		}
-	}
-	printf("Number of objects found on boundary: %i\n", label - 2);
-#pragma omp parallel
-	for (int imageNo = 0; imageNo < 2; imageNo++)
-	{
-		singlePassLabeling(dstData3D, imageNo * (kMid + 1), kMid + imageNo * (DIM_Z - kMid), (label << 1) + imageNo, 2);
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, VOLUME_FILE_MAGIC, sizeof(header.magic));
+	header.version = VOLUME_FILE_VERSION;
+	header.voxelType = (uint32_t)voxelSize;
+	header.packing = (uint32_t)packing;
+	header.dimX = dimX;
+	header.dimY = dimY;
+	header.dimZ = dimZ;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+		printf("Failed to write the header of %s.\n", fname);
+		exit(1);
 	}
-	destroyStack(iStack);
-	destroyStack(jStack);
-	destroyStack(kStack);
 }
 
-/*Print a 2D slice of an 3D image, where the z-direction is kept constant. */
-void printZSliceSource(srcPixelType ***srcData3D, SizeType k)
+/* Check that a volume file header is valid and describes voxels of voxelSize
+   bytes, which may be bit-packed if they are binary source voxels. */
+void checkVolumeHeader(const struct VolumeFileHeader *header, const char *fname, size_t voxelSize)
 {
-	if (k < 0)
-	{
-		printf("Index out of range\n");
-		return;
+	if (memcmp(header->magic, VOLUME_FILE_MAGIC, sizeof(header->magic)) != 0 ||
+		header->version != VOLUME_FILE_VERSION) {
+		printf("%s is not a volume file of version %d. \n", fname, VOLUME_FILE_VERSION);
+		exit(1);
 	}
-	if (k >= DIM_Z)
-	{
-		printf("Index out of range\n");
-		return;
+	if (header->voxelType != voxelSize ||
+		(header->packing != VOLUME_PACKING_NONE &&
+		(header->packing != VOLUME_PACKING_BITS || voxelSize != sizeof(srcPixelType)))) {
+		printf("%s holds voxels of %u bytes with packing %u, expected %zu bytes. \n",
+			fname, header->voxelType, header->packing, voxelSize);
+		exit(1);
 	}
-	SizeType i, j;
-	for (j = 0; j < DIM_Y; j++)
-	{
-		for (i = 0; i < DIM_X; i++)
-		{
-			printf("%i ", srcData3D[k][j][i]);
-		}
-		printf("\n");
-
+	if (header->dimX <= 0 || header->dimY <= 0 || header->dimZ <= 0) {
+		printf("%s has invalid dimensions. \n", fname);
+		exit(1);
 	}
-	printf("\n");
 }
 
-void printZSliceDestination(dstPixelType ***dstData3D, SizeType k)
+/* Write a volume to a binary volume file: a VolumeFileHeader followed by the
+   voxels. */
+void writeVolumeFile(const char *fname, const struct Volume *vol)
 {
-	if (k < 0)
-	{
-		printf("Index out of range\n");
-		return;
-	}
-	if (k >= DIM_Z)
-	{
-		printf("Index out of range\n");
-		return;
+	SizeType j, k;
+	size_t rowLength;
+	FILE *fp;
+
+	fp = fopen(fname, "wb");
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", fname);
+		exit(1);
 	}
-	SizeType i, j;
-	for (j = 0; j < DIM_Y; j++)
-	{
-		for (i = 0; i < DIM_X; i++)
-		{
-			printf("%i ", dstData3D[k][j][i]);
+	writeVolumeHeader(fp, fname, vol->dimX, vol->dimY, vol->dimZ,
+		vol->packing == VOLUME_PACKING_BITS ? sizeof(srcPixelType) : vol->elemSize, vol->packing);
+	rowLength = (size_t)volumeRowLength(vol);
+	for (k = 0; k < vol->dimZ; k++) {
+		for (j = 0; j < vol->dimY; j++) {
+			const char *row = (const char *)vol->data + (k * vol->strideZ + j * vol->strideY) * vol->elemSize;
+			if (fwrite(row, vol->elemSize, rowLength, fp) != rowLength) {
+				printf("Failed to write to %s.\n", fname);
+				printf("%s\n", strerror(errno));
+				exit(1);
+			}
 		}
-		printf("\n");
 	}
-	printf("\n");
+	fclose(fp);
 }
 
-void freeImages(srcPixelType ***srcData3D, dstPixelType ***dstData3D)
+/* Map a binary volume file into memory and let vol view its voxels, without
+   reading or copying them. Pages are loaded on first access. The mapping is
+   private, so writes to the volume never reach the file. The voxels must be
+   voxelSize bytes large; files of binary voxels may also be bit-packed. */
+void mapVolumeFile(const char *fname, struct Volume *vol, size_t voxelSize)
 {
-	SizeType j, k;
+	const struct VolumeFileHeader *header;
+	void *mapping;
+	size_t mappingSize, dataSize, elemSize;
+	SizeType rowLength;
 
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			if (srcData3D[k][j] != NULL) {
-				free(srcData3D[k][j]);
-			}
-			else {
-				printf("Warning: srcData3D[][] was NULL during free.\n");
-			}
-		}
-		if (srcData3D[k] != NULL) {
-			free(srcData3D[k]);
-		}
-		else {
-			printf("Warning: srcData3D[] was NULL during free.\n");
-		}
-	}
-	if (srcData3D != NULL) {
-		free(srcData3D);
+#ifdef _WIN32
+	HANDLE file, fileMapping;
+	LARGE_INTEGER fileSize;
+
+	file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &fileSize)) {
+		printf("Failed to open %s for reading. \n", fname);
+		exit(1);
 	}
-	else {
-		printf("Warning: srcData3D was NULL during free.\n");
+	mappingSize = (size_t)fileSize.QuadPart;
+	fileMapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+	mapping = fileMapping == NULL ? NULL : MapViewOfFile(fileMapping, FILE_MAP_COPY, 0, 0, 0);
+	if (fileMapping != NULL) CloseHandle(fileMapping);
+	CloseHandle(file);
+	if (mapping == NULL) {
+		printf("Failed to map %s into memory. \n", fname);
+		exit(1);
 	}
+#else
+	struct stat fileStat;
+	int fd;
 
-	for (k = 0; k < DIM_Z; k++) {
-		for (j = 0; j < DIM_Y; j++) {
-			if (dstData3D[k][j] != NULL) {
-				free(dstData3D[k][j]);
-			}
-			else {
-				printf("Warning: dstData3D[][] was NULL during free.\n");
-			}
-		}
-		if (dstData3D[k] != NULL) {
-			free(dstData3D[k]);
-		}
-		else {
-			printf("Warning: dstData3D[] was NULL during free.\n");
-		}
+	fd = open(fname, O_RDONLY);
+	if (fd < 0 || fstat(fd, &fileStat) != 0) {
+		printf("Failed to open %s for reading. \n", fname);
+		exit(1);
 	}
-	if (dstData3D != NULL) {
-		free(dstData3D);
+	mappingSize = (size_t)fileStat.st_size;
+	if (mappingSize == 0) {
+		printf("%s is too small to be a volume file. \n", fname);
+		exit(1);
 	}
-	else {
-		printf("Warning: dstData3D was NULL during free.\n");
+	mapping = mmap(NULL, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		printf("Failed to map %s into memory: %s\n", fname, strerror(errno));
+		exit(1);
+	}
+	posix_madvise(mapping, mappingSize, POSIX_MADV_WILLNEED);
+#endif
+
+	header = (const struct VolumeFileHeader *)mapping;
+	if (mappingSize < sizeof(struct VolumeFileHeader)) {
+		printf("%s is too small to be a volume file. \n", fname);
+		exit(1);
+	}
+	checkVolumeHeader(header, fname, voxelSize);
+	elemSize = header->packing == VOLUME_PACKING_BITS ? sizeof(uint64_t) : voxelSize;
+	rowLength = header->packing == VOLUME_PACKING_BITS ? packedRowWords((SizeType)header->dimX) : (SizeType)header->dimX;
+	dataSize = (size_t)(rowLength * header->dimY * header->dimZ) * elemSize;
+	if (mappingSize - sizeof(struct VolumeFileHeader) < dataSize) {
+		printf("%s is truncated or has invalid dimensions. \n", fname);
+		exit(1);
 	}
+
+	vol->data = (char *)mapping + sizeof(struct VolumeFileHeader);
+	vol->dimX = (SizeType)header->dimX;
+	vol->dimY = (SizeType)header->dimY;
+	vol->dimZ = (SizeType)header->dimZ;
+	vol->strideY = rowLength;
+	vol->strideZ = rowLength * vol->dimY;
+	vol->elemSize = elemSize;
+	vol->packing = (int)header->packing;
+	vol->zeroed = 0;
+	vol->mapping = mapping;
+	vol->mappingSize = mappingSize;
 }
 
-int main(void)
+/* Read a binary volume file of voxels of voxelSize bytes, which may be
+   bit-packed if they are binary source voxels, into vol. Unlike
+   mapVolumeFile every voxel is in memory on return, so a thread reading a
+   file here does all its I/O. vol is allocated here, unless it was read into
+   before and *capacity, its size in bytes, is large enough; free it with
+   freeVolume. */
+void readVolumeFile(const char *fname, struct Volume *vol, size_t *capacity, size_t voxelSize)
 {
-	srcPixelType   ***srcData3D;
-	dstPixelType   ***dstData3D;
+	struct VolumeFileHeader header;
+	size_t dataSize, elemSize;
+	SizeType rowLength;
+	FILE *fp;
 
-	printf("Dims: %td, %td, %td\n", DIM_X, DIM_Y, DIM_Z);
-	printf("Volume: %td\n", VOLUME);
+	fp = fopen(fname, "rb");
+	if (fp == NULL || fread(&header, sizeof(header), 1, fp) != 1) {
+		printf("Failed to read the header of %s. \n", fname);
+		exit(1);
+	}
+	checkVolumeHeader(&header, fname, voxelSize);
+	elemSize = header.packing == VOLUME_PACKING_BITS ? sizeof(uint64_t) : voxelSize;
+	rowLength = header.packing == VOLUME_PACKING_BITS ? packedRowWords((SizeType)header.dimX) : (SizeType)header.dimX;
+	dataSize = (size_t)(rowLength * header.dimY * header.dimZ) * elemSize;
+	if (vol->data == NULL || dataSize > *capacity) {
+		if (vol->data != NULL) freeVolume(vol);
+		allocateVolume(vol, rowLength, (SizeType)header.dimY, (SizeType)header.dimZ, elemSize);
+		*capacity = dataSize;
+	}
+	vol->dimX = (SizeType)header.dimX;
+	vol->dimY = (SizeType)header.dimY;
+	vol->dimZ = (SizeType)header.dimZ;
+	vol->strideY = rowLength;
+	vol->strideZ = rowLength * vol->dimY;
+	vol->elemSize = elemSize;
+	vol->packing = (int)header.packing;
+	vol->zeroed = 0;
+	if (fread(vol->data, 1, dataSize, fp) != dataSize) {
+		printf("%s is truncated or has invalid dimensions. \n", fname);
+		exit(1);
+	}
+	fclose(fp);
+}
 
-	/* Allocate memory for source and destination images. Passing by
-	   reference results in a pointer to a pointer to a pointer to a
-	   pointer being passed. */
-	allocateImages(&srcData3D, &dstData3D);
+/* Convert an image of ascii '0' and '1' characters to a binary volume file,
+   bit-packed if packing is VOLUME_PACKING_BITS. This only has to be done once
+   per image. */
+void convertAsciiToVolumeFile(const char *txtName, SizeType dimX, SizeType dimY, SizeType dimZ, int packing, const char *volName)
+{
+	struct Volume srcVol;
 
-	/* Read the source image. */
-	readSrcImg(srcData3D);
+	if (packing == VOLUME_PACKING_BITS) {
+		allocatePackedVolume(&srcVol, dimX, dimY, dimZ);
+	}
+	else {
+		allocateVolume(&srcVol, dimX, dimY, dimZ, sizeof(srcPixelType));
+	}
+	readAsciiImg(txtName, &srcVol);
+	writeVolumeFile(volName, &srcVol);
+	freeVolume(&srcVol);
+	printf("Converted %s to %s.\n", txtName, volName);
+}
 
-	clock_t start, end;
-	float seconds;
-	/*Start clocking*/
-	start = clock();
+/* Synthetic volumes, a deterministic function of a seed and the voxel
+   coordinates, so they are the same whatever the number of threads and can be
+   generated plane by plane at any size:
+     percolation  every voxel is an object voxel with probability density
+     spheres      balls of radius size / 2 to size, one per cell of a grid,
+                  that never touch, not even at corners
+     helices      tubes winding along Z with radius size around axes on a grid,
+                  so every object crosses every slab boundary
+     spiral       a square spiral of arm spacing size around the center,
+                  extruded along Z: a single object with a very long path in
+                  every plane, apart from outer arms cut off by the border
+     giant        a lattice of lines along X, Y and Z with spacing size,
+                  which is one component spanning the volume, plus noise
+                  voxels with probability density */
+enum GeneratorPattern { PATTERN_PERCOLATION, PATTERN_SPHERES, PATTERN_HELICES, PATTERN_SPIRAL, PATTERN_GIANT };
 
-	/*Set the values of the destination image to those of the source image.*/
-	setDstToSource(srcData3D, dstData3D);
+struct Generator {
+	enum GeneratorPattern pattern;
+	uint64_t  seed;
+	uint64_t  threshold;            /* Noise voxels are those hashing below threshold. */
+	SizeType  size;
+	SizeType  dimX, dimY, dimZ;
+	double   *helixX, *helixY;      /* Offset of the helix axis point of every plane from the center of its cell. */
+};
 
-	singlePassLabelingDefault(dstData3D);
+/* A well-mixed 64-bit hash of x (splitmix64). */
+static inline uint64_t hash64(uint64_t x)
+{
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
 
-	/*parallelEdgeFirstSinglePassLabeling(dstData3D);*/
+static inline uint64_t hashVoxel(uint64_t seed, SizeType i, SizeType j, SizeType k)
+{
+	return hash64(seed ^ hash64((uint64_t)i ^ hash64((uint64_t)j ^ hash64((uint64_t)k))));
+}
 
-	/*End clocking*/
-	end = clock();
-	seconds = (float)(end - start) / CLOCKS_PER_SEC;
-	printf("Labeling the image took %f seconds to complete\n\n", seconds);
+void initGenerator(struct Generator *gen, const char *pattern, uint64_t seed, double density, SizeType size,
+	SizeType dimX, SizeType dimY, SizeType dimZ)
+{
+	static const char *patternNames[] = { "percolation", "spheres", "helices", "spiral", "giant" };
+	int p;
 
-	/*Start clocking*/
-	start = clock();
+	memset(gen, 0, sizeof(*gen));
+	for (p = 0; p < 5 && strcmp(pattern, patternNames[p]) != 0; p++);
+	if (p == 5) {
+		printf("Unknown pattern %s, use percolation, spheres, helices, spiral or giant.\n", pattern);
+		exit(1);
+	}
+	if (size < 4 || density < 0.0) {
+		printf("Generated volumes need a size of at least 4 and a density of at least 0.\n");
+		exit(1);
+	}
+	gen->pattern = (enum GeneratorPattern)p;
+	gen->seed = hash64(seed);
+	gen->threshold = density >= 1.0 ? UINT64_MAX : (uint64_t)(density * 18446744073709551616.0);
+	gen->size = size;
+	gen->dimX = dimX;
+	gen->dimY = dimY;
+	gen->dimZ = dimZ;
 
-	/*Set the values of the destination image to those of the source image.*/
-	setDstToSource(srcData3D, dstData3D);
+	if (gen->pattern == PATTERN_HELICES) {
+		/* The axis turns by 1 / size radians per plane, so it moves by about
+		   one voxel. The rotation is repeated from cos and sin of that angle,
+		   which their series give to double precision for angles of at most
+		   1 / 4, and renormalized to keep its radius. */
+		const double angle = 1.0 / (double)size, a2 = angle * angle;
+		const double c = 1.0 - a2 / 2.0 * (1.0 - a2 / 12.0 * (1.0 - a2 / 30.0 * (1.0 - a2 / 56.0)));
+		const double sn = angle * (1.0 - a2 / 6.0 * (1.0 - a2 / 20.0 * (1.0 - a2 / 42.0 * (1.0 - a2 / 72.0))));
+		double x = 1.0, y = 0.0;
+		SizeType k;
 
-	/*singlePassLabelingDefault(dstData3D);*/
+		gen->helixX = (double *)malloc((dimZ > 0 ? dimZ : 1) * sizeof(double));
+		gen->helixY = (double *)malloc((dimZ > 0 ? dimZ : 1) * sizeof(double));
+		if (gen->helixX == NULL || gen->helixY == NULL) {
+			printf("Failed to allocate the helix table. \n");
+			exit(1);
+		}
+		for (k = 0; k < dimZ; k++) {
+			const double t = x * c - y * sn, r2 = t * t + (x * sn + y * c) * (x * sn + y * c);
 
-	parallelEdgeFirstSinglePassLabeling(dstData3D);
+			gen->helixX[k] = (double)size * x;
+			gen->helixY[k] = (double)size * y;
+			y = (x * sn + y * c) * (1.5 - 0.5 * r2);
+			x = t * (1.5 - 0.5 * r2);
+		}
+	}
+}
 
-	/*End clocking*/
-	end = clock();
-	seconds = (float)(end - start) / CLOCKS_PER_SEC;
-	printf("Labeling the image took %f seconds to complete\n\n", seconds);
+void freeGenerator(struct Generator *gen)
+{
+	free(gen->helixX);
+	free(gen->helixY);
+	gen->helixX = gen->helixY = NULL;
+}
+
+/* Whether (x, y), relative to the center, lies on the square spiral of arm
+   spacing s and arm thickness t. Arm n consists of the four sides of the
+   square of half width n * s, except that its right side starts only at the
+   bottom of arm n - 1 and its bottom side runs on to the right side of arm
+   n + 1, so the arms form a single path. */
+static inline int onSquareSpiral(SizeType x, SizeType y, SizeType s, SizeType t)
+{
+	const SizeType m = (x < 0 ? -x : x) > (y < 0 ? -y : y) ? (x < 0 ? -x : x) : (y < 0 ? -y : y);
+	SizeType n;
+
+	for (n = m / s - 1; n <= m / s + 1; n++) {
+		const SizeType r = n * s;
+		if (n < 0) continue;
+		if (x >= r && x < r + t && y >= -r + s && y < r + t) return 1;
+		if (y >= r && y < r + t && x >= -r && x < r + t) return 1;
+		if (x >= -r && x < -r + t && y >= -r && y < r + t) return 1;
+		if (y >= -r && y < -r + t && x >= -r && x < r + s + t) return 1;
+	}
+	return 0;
+}
+
+/* Whether voxel (i, j, k) of the generated volume is an object voxel. */
+static inline int generatedVoxel(const struct Generator *gen, SizeType i, SizeType j, SizeType k)
+{
+	const SizeType size = gen->size;
+
+	switch (gen->pattern) {
+	case PATTERN_PERCOLATION:
+		return hashVoxel(gen->seed, i, j, k) < gen->threshold;
+	case PATTERN_SPHERES: {
+		/* The balls stay within size of the center of cells of 2 * size + 2
+		   voxels, so at least one background voxel separates them. */
+		const SizeType cell = 2 * size + 2;
+		const uint64_t h = hashVoxel(gen->seed, i / cell, j / cell, k / cell);
+		const SizeType radius = size / 2 + (SizeType)(h % (uint64_t)(size - size / 2 + 1));
+		const SizeType slack = size - radius;
+		const SizeType di = i % cell - size - (SizeType)((h >> 16) % (uint64_t)(2 * slack + 1)) + slack;
+		const SizeType dj = j % cell - size - (SizeType)((h >> 32) % (uint64_t)(2 * slack + 1)) + slack;
+		const SizeType dk = k % cell - size - (SizeType)((h >> 48) % (uint64_t)(2 * slack + 1)) + slack;
+		return di * di + dj * dj + dk * dk <= radius * radius;
+	}
+	case PATTERN_HELICES: {
+		/* Tubes of radius 2 around axes of radius size, in cells of
+		   2 * size + 6 voxels that keep them apart; each helix gets its own
+		   quarter turn and handedness. */
+		const SizeType cell = 2 * size + 6;
+		const uint64_t h = hashVoxel(gen->seed, i / cell, j / cell, 0);
+		const double x = (double)(i % cell - size - 3), y = (double)(j % cell - size - 3);
+		double ax = gen->helixX[k], ay = (h & 4) ? -gen->helixY[k] : gen->helixY[k], dx, dy;
+		switch (h & 3) {
+		case 1: dx = ax; ax = -ay; ay = dx; break;
+		case 2: ax = -ax; ay = -ay; break;
+		case 3: dx = ax; ax = ay; ay = -dx; break;
+		default: break;
+		}
+		dx = x - ax;
+		dy = y - ay;
+		return dx * dx + dy * dy <= 4.0;
+	}
+	case PATTERN_SPIRAL:
+		return onSquareSpiral(i - gen->dimX / 2, j - gen->dimY / 2, size, size / 2 - 1);
+	default:
+		return (i % size == 0 ? j % size == 0 || k % size == 0 : j % size == 0 && k % size == 0)
+			|| hashVoxel(gen->seed, i, j, k) < gen->threshold;
+	}
+}
+
+/* Fill vol, which may be bit-packed, with planes kStart up to kStart +
+   vol->dimZ of the generated volume. */
+void generateVolume(const struct Generator *gen, struct Volume *vol, SizeType kStart)
+{
+	SizeType j, k;
+
+#pragma omp parallel for collapse(2) schedule(dynamic, 16)
+	for (k = 0; k < vol->dimZ; k++) {
+		for (j = 0; j < vol->dimY; j++) {
+			SizeType i;
+
+			if (vol->packing == VOLUME_PACKING_BITS) {
+				uint64_t *words = (uint64_t *)vol->data + k * vol->strideZ + j * vol->strideY;
+				for (i = 0; i < packedRowWords(vol->dimX); i++) {
+					words[i] = 0;
+				}
+				for (i = 0; i < vol->dimX; i++) {
+					words[i / 64] |= (uint64_t)generatedVoxel(gen, i, j, kStart + k) << (i % 64);
+				}
+			}
+			else {
+				srcPixelType *src = (srcPixelType *)vol->data + k * vol->strideZ + j * vol->strideY;
+				for (i = 0; i < vol->dimX; i++) {
+					src[i] = (srcPixelType)generatedVoxel(gen, i, j, kStart + k);
+				}
+			}
+		}
+	}
+}
+
+/* Write the generated volume to a volume file one plane at a time, so its
+   size is not limited by memory. */
+void generateVolumeFile(const struct Generator *gen, int packing, const char *fname)
+{
+	struct Volume plane;
+	size_t planeLength;
+	SizeType k;
+	FILE *fp;
+
+	if (packing == VOLUME_PACKING_BITS) {
+		allocatePackedVolume(&plane, gen->dimX, gen->dimY, 1);
+	}
+	else {
+		allocateVolume(&plane, gen->dimX, gen->dimY, 1, sizeof(srcPixelType));
+	}
+	fp = fopen(fname, "wb");
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", fname);
+		exit(1);
+	}
+	writeVolumeHeader(fp, fname, gen->dimX, gen->dimY, gen->dimZ, sizeof(srcPixelType), packing);
+	planeLength = (size_t)(volumeRowLength(&plane) * gen->dimY);
+	for (k = 0; k < gen->dimZ; k++) {
+		generateVolume(gen, &plane, k);
+		if (fwrite(plane.data, plane.elemSize, planeLength, fp) != planeLength) {
+			printf("Failed to write to %s.\n", fname);
+			printf("%s\n", strerror(errno));
+			exit(1);
+		}
+	}
+	fclose(fp);
+	freeVolume(&plane);
+}
+
+/* Whether connectivity is a supported neighborhood: 6 (voxels sharing a
+   face), 18 (a face or an edge) or 26 (a face, an edge or a corner).
+   checkConnectivity exits unless it is. */
+int validConnectivity(int connectivity)
+{
+	return connectivity == 6 || connectivity == 18 || connectivity == 26;
+}
+
+void checkConnectivity(int connectivity)
+{
+	if (!validConnectivity(connectivity)) {
+		printf("Unsupported connectivity %d, use 6, 18 or 26.\n", connectivity);
+		exit(1);
+	}
+}
+
+/* Return result, the count returned by blockUnionFindLabelingWith,
+   relabelEdits or neighborHistogramWith, unless it is one of the error codes
+   of Parallel_Labeling.h, for which the program exits with a message, as the
+   library never does. */
+SizeType checkLabelingResult(SizeType result)
+{
+	if (result == LABELING_ERROR_MEMORY) {
+		printf("Ran out of memory while labeling. \n");
+		exit(1);
+	}
+	if (result == LABELING_ERROR_ARGUMENT) {
+		printf("Invalid arguments to a labeling engine. \n");
+		exit(1);
+	}
+	if (result == LABELING_ERROR_LABELS) {
+		printf("Too many objects for %d-bit labels, compile with a larger LABEL_BITS.\n", LABEL_BITS);
+		exit(1);
+	}
+	return result;
+}
+
+/* The largest number of coordinates in which a neighbor may differ from a
+   voxel: 1 for 6-connectivity, 2 for 18 and 3 for 26. */
+int neighborOrder(int connectivity)
+{
+	return connectivity == 6 ? 1 : connectivity == 18 ? 2 : 3;
+}
+
+/* Allocate zeroed histograms of nBins bins, one per thread, as the rows of
+   hist. The rows are padded to whole cache lines, so threads that each count
+   into their own row never write to the same line, whatever nBins is.
+   Return 0 when memory runs out, see tryAllocateVolume, and 1 otherwise. */
+int tryAllocateThreadHistograms(struct Volume *hist, SizeType nBins)
+{
+	const SizeType binsPerLine = (SizeType)(VOLUME_ALIGNMENT / sizeof(SizeType));
+
+	if (!tryAllocateVolume(hist, (nBins + binsPerLine - 1) / binsPerLine * binsPerLine, omp_get_max_threads(), 1, sizeof(SizeType))) {
+		return 0;
+	}
+	memset(hist->data, 0, (size_t)(hist->strideZ) * sizeof(SizeType));
+	hist->dimX = nBins;
+	return 1;
+}
+
+void allocateThreadHistograms(struct Volume *hist, SizeType nBins)
+{
+	if (!tryAllocateThreadHistograms(hist, nBins)) {
+		printf("Failed to allocate histograms for %d threads. \n", omp_get_max_threads());
+		exit(1);
+	}
+}
+
+/* The histogram of the calling thread. */
+SizeType *threadHistogram(const struct Volume *hist)
+{
+	return (SizeType *)hist->data + omp_get_thread_num() * hist->strideY;
+}
+
+/* Add up the histograms of all threads into sums[0] up to sums[nBins - 1]. */
+void sumThreadHistograms(const struct Volume *hist, SizeType *sums)
+{
+	const SizeType *bins = (const SizeType *)hist->data;
+	SizeType n, t;
+
+	for (n = 0; n < hist->dimX; n++) {
+		sums[n] = 0;
+		for (t = 0; t < hist->dimY; t++) {
+			sums[n] += bins[t * hist->strideY + n];
+		}
+	}
+}
+
+/* Sum the 6-connected neighbors of the 64 voxels in word w of row (j, k) of a
+   bit-packed volume with shifts and bit-sliced full adders. The neighbor
+   count of voxel b of the word is bit b of count0 + 2 * count1 + 4 * count2.
+   Neighbors outside the volume count as 0, as do the unused bits of a row. */
+void countNeighborsPacked(const struct Volume *bitVol, SizeType j, SizeType k, SizeType w,
+	uint64_t *count0, uint64_t *count1, uint64_t *count2)
+{
+	const uint64_t *row = (const uint64_t *)bitVol->data + k * bitVol->strideZ + j * bitVol->strideY;
+	const SizeType nWords = packedRowWords(bitVol->dimX);
+	uint64_t center = row[w];
+	uint64_t prev = w > 0 ? row[w - 1] : 0;
+	uint64_t next = w < nWords - 1 ? row[w + 1] : 0;
+	uint64_t left = center << 1 | prev >> 63;  /* Bit b holds voxel b - 1. */
+	uint64_t right = center >> 1 | next << 63; /* Bit b holds voxel b + 1. */
+	uint64_t down = j > 0 ? row[w - bitVol->strideY] : 0;
+	uint64_t up = j < bitVol->dimY - 1 ? row[w + bitVol->strideY] : 0;
+	uint64_t back = k > 0 ? row[w - bitVol->strideZ] : 0;
+	uint64_t front = k < bitVol->dimZ - 1 ? row[w + bitVol->strideZ] : 0;
+	uint64_t sumA, carryA, sumB, carryB, carry;
+
+	sumA = left ^ right ^ down;
+	carryA = (left & right) | (down & (left ^ right));
+	sumB = up ^ back ^ front;
+	carryB = (up & back) | (front & (up ^ back));
+	carry = sumA & sumB;
+	*count0 = sumA ^ sumB;
+	*count1 = carryA ^ carryB ^ carry;
+	*count2 = (carryA & carryB) | (carry & (carryA ^ carryB));
+}
+
+/* Add one bit per voxel, x, to the bit-sliced counters count[0] to count[4]:
+   the count of voxel b is the sum of (count[n] >> b & 1) << n. */
+static inline void addBitSliced(uint64_t count[5], uint64_t x)
+{
+	int n;
+	for (n = 0; n < 5; n++) {
+		uint64_t carry = count[n] & x;
+		count[n] ^= x;
+		x = carry;
+	}
+}
+
+/* Count the 18- or 26-connected neighbors of the 64 voxels in word w of row
+   (j, k) of a bit-packed volume into five bit-sliced counters. Each of the
+   nine rows around the voxels adds its own word and, if those neighbors are
+   part of the neighborhood, its words shifted one voxel left and right. */
+void countNeighborsPackedConnected(const struct Volume *bitVol, SizeType j, SizeType k, SizeType w, int connectivity, uint64_t count[5])
+{
+	const SizeType nWords = packedRowWords(bitVol->dimX);
+	const int maxOrder = neighborOrder(connectivity);
+	int dj, dk, n;
+
+	for (n = 0; n < 5; n++) count[n] = 0;
+	for (dk = -1; dk <= 1; dk++) {
+		if (k + dk < 0 || k + dk >= bitVol->dimZ) continue;
+		for (dj = -1; dj <= 1; dj++) {
+			const int order = (dj != 0) + (dk != 0);
+			const uint64_t *row;
+			uint64_t center, prev, next;
+
+			if (j + dj < 0 || j + dj >= bitVol->dimY) continue;
+			row = (const uint64_t *)bitVol->data + (k + dk) * bitVol->strideZ + (j + dj) * bitVol->strideY;
+			center = row[w];
+			prev = w > 0 ? row[w - 1] : 0;
+			next = w < nWords - 1 ? row[w + 1] : 0;
+			if (order > 0) addBitSliced(count, center);
+			if (order + 1 <= maxOrder) {
+				addBitSliced(count, center << 1 | prev >> 63);
+				addBitSliced(count, center >> 1 | next << 63);
+			}
+		}
+	}
+}
+
+/* The process() kernel for a bit-packed source volume with 18- or
+   26-connectivity. */
+void processPackedConnected(const struct Volume *bitVol, struct Volume *dstVol, int connectivity)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType nWords = packedRowWords(bitVol->dimX);
+	SizeType j, k, w;
+
+#pragma omp parallel for collapse(2) private(w)
+	for (k = 0; k < bitVol->dimZ; k++) {
+		for (j = 0; j < bitVol->dimY; j++) {
+			dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			for (w = 0; w < nWords; w++) {
+				uint64_t count[5];
+				SizeType b, nBits;
+
+				countNeighborsPackedConnected(bitVol, j, k, w, connectivity, count);
+				nBits = bitVol->dimX - 64 * w < 64 ? bitVol->dimX - 64 * w : 64;
+				for (b = 0; b < nBits; b++) {
+					dst[64 * w + b] = (dstPixelType)((count[0] >> b & 1) | (count[1] >> b & 1) << 1 |
+						(count[2] >> b & 1) << 2 | (count[3] >> b & 1) << 3 | (count[4] >> b & 1) << 4);
+				}
+			}
+		}
+	}
+}
+
+/* The process() kernel for a bit-packed source volume. */
+void processPacked(const struct Volume *bitVol, struct Volume *dstVol, int connectivity)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType nWords = packedRowWords(bitVol->dimX);
+	SizeType j, k, w;
+
+	dstVol->zeroed = 0;
+	if (connectivity != 6) {
+		processPackedConnected(bitVol, dstVol, connectivity);
+		return;
+	}
+
+#pragma omp parallel for collapse(2) private(w)
+	for (k = 0; k < bitVol->dimZ; k++) {
+		for (j = 0; j < bitVol->dimY; j++) {
+			dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			for (w = 0; w < nWords; w++) {
+				uint64_t count0, count1, count2;
+				SizeType b, nBits;
+
+				countNeighborsPacked(bitVol, j, k, w, &count0, &count1, &count2);
+				nBits = bitVol->dimX - 64 * w < 64 ? bitVol->dimX - 64 * w : 64;
+				for (b = 0; b < nBits; b++) {
+					dst[64 * w + b] = (dstPixelType)((count0 >> b & 1) | (count1 >> b & 1) << 1 | (count2 >> b & 1) << 2);
+				}
+			}
+		}
+	}
+}
+
+/* neighborHistogramPacked for 18- or 26-connectivity, counting into hist,
+   thread histograms allocated by allocateThreadHistograms. */
+void neighborHistogramPackedConnected(const struct Volume *bitVol, int connectivity, struct Volume *hist)
+{
+	const SizeType nWords = packedRowWords(bitVol->dimX);
+	SizeType j, k;
+
+#pragma omp parallel for collapse(2)
+	for (k = 0; k < bitVol->dimZ; k++) {
+		for (j = 0; j < bitVol->dimY; j++) {
+			SizeType *bins = threadHistogram(hist);
+			SizeType w;
+			int n;
+
+			for (w = 0; w < nWords; w++) {
+				uint64_t count[5], valid;
+
+				countNeighborsPackedConnected(bitVol, j, k, w, connectivity, count);
+				valid = bitVol->dimX - 64 * w < 64 ? ((uint64_t)1 << (bitVol->dimX - 64 * w)) - 1 : ~(uint64_t)0;
+				for (n = 0; n <= connectivity; n++) {
+					uint64_t match = valid;
+					match &= n & 1 ? count[0] : ~count[0];
+					match &= n & 2 ? count[1] : ~count[1];
+					match &= n & 4 ? count[2] : ~count[2];
+					match &= n & 8 ? count[3] : ~count[3];
+					match &= n & 16 ? count[4] : ~count[4];
+					bins[n] += popcount64(match);
+				}
+			}
+		}
+	}
+}
+
+/* Compute the histogram of neighbor counts of a bit-packed volume without a
+   destination image: the voxels of a word having n neighbors are selected
+   from the counter bit planes and counted with one popcount. Like someOutput,
+   every thread counts into its own padded histogram. */
+void neighborHistogramPacked(const struct Volume *bitVol, SizeType sums[MAX_NEIGHBORS + 1], int connectivity)
+{
+	const SizeType nWords = packedRowWords(bitVol->dimX);
+	struct Volume hist;
+	SizeType j, k;
+	int n;
+
+	allocateThreadHistograms(&hist, connectivity + 1);
+	if (connectivity != 6) {
+		neighborHistogramPackedConnected(bitVol, connectivity, &hist);
+	}
+	else {
+#pragma omp parallel for collapse(2)
+		for (k = 0; k < bitVol->dimZ; k++) {
+			for (j = 0; j < bitVol->dimY; j++) {
+				SizeType *bins = threadHistogram(&hist);
+				SizeType w;
+
+				for (w = 0; w < nWords; w++) {
+					uint64_t count0, count1, count2, valid;
+					int bin;
+
+					countNeighborsPacked(bitVol, j, k, w, &count0, &count1, &count2);
+					valid = bitVol->dimX - 64 * w < 64 ? ((uint64_t)1 << (bitVol->dimX - 64 * w)) - 1 : ~(uint64_t)0;
+					for (bin = 0; bin < 7; bin++) {
+						uint64_t match = valid;
+						match &= bin & 1 ? count0 : ~count0;
+						match &= bin & 2 ? count1 : ~count1;
+						match &= bin & 4 ? count2 : ~count2;
+						bins[bin] += popcount64(match);
+					}
+				}
+			}
+		}
+	}
+	for (n = 0; n <= MAX_NEIGHBORS; n++) sums[n] = 0;
+	sumThreadHistograms(&hist, sums);
+	freeVolume(&hist);
+}
+
+/* Count the nonzero 6-connected neighbors of voxel i of the row at src, with
+   bounds checks on every neighbor. below and above point to the same row in
+   the previous and next Z-plane, or are NULL when that plane does not exist.
+   This is the scalar path for the outer shell of the volume. */
+dstPixelType countNeighborsChecked(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	SizeType i, SizeType j, SizeType dimX, SizeType dimY, SizeType strideY)
+{
+	dstPixelType   result;
+
+	result = 0;
+	if (i >= 1) {
+		if (src[i - 1] != 0) result++;
+	}
+	if (i < dimX - 1) {
+		if (src[i + 1] != 0) result++;
+	}
+
+	if (j >= 1) {
+		if (src[i - strideY] != 0) result++;
+	}
+	if (j < dimY - 1) {
+		if (src[i + strideY] != 0) result++;
+	}
+
+	if (below != NULL) {
+		if (below[i] != 0) result++;
+	}
+	if (above != NULL) {
+		if (above[i] != 0) result++;
+	}
+	return result;
+}
+
+/* Count the nonzero 18- or 26-connected neighbors of voxel i of the row at
+   src, with bounds checks on every neighbor, like countNeighborsChecked. */
+dstPixelType countNeighborsCheckedConnected(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	SizeType i, SizeType j, SizeType dimX, SizeType dimY, SizeType strideY, int connectivity)
+{
+	const srcPixelType *planes[3] = { below, src, above };
+	const int maxOrder = neighborOrder(connectivity);
+	dstPixelType result = 0;
+	int di, dj, dk;
+
+	for (dk = -1; dk <= 1; dk++) {
+		if (planes[dk + 1] == NULL) continue;
+		for (dj = -1; dj <= 1; dj++) {
+			if (j + dj < 0 || j + dj >= dimY) continue;
+			for (di = -1; di <= 1; di++) {
+				const int order = (di != 0) + (dj != 0) + (dk != 0);
+				if (order == 0 || order > maxOrder || i + di < 0 || i + di >= dimX) continue;
+				if (planes[dk + 1][i + di + dj * strideY] != 0) result++;
+			}
+		}
+	}
+	return result;
+}
+
+/* A kernel counting the neighbors of n consecutive voxels that all lie in the
+   interior of the volume, so all their neighbors exist and need no checks. */
+typedef void (*InteriorRowKernel)(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType n, SizeType strideY);
+
+void processInteriorRowScalar(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType n, SizeType strideY)
+{
+	SizeType i;
+	for (i = 0; i < n; i++) {
+		dst[i] = (dstPixelType)((src[i - 1] != 0) + (src[i + 1] != 0) +
+			(src[i - strideY] != 0) + (src[i + strideY] != 0) +
+			(below[i] != 0) + (above[i] != 0));
+	}
+}
+
+/* The interior kernels for 18- and 26-connectivity, with every neighbor
+   offset spelled out. */
+void processInteriorRow18(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType n, SizeType strideY)
+{
+	SizeType i;
+	for (i = 0; i < n; i++) {
+		const srcPixelType *b = below + i, *c = src + i, *a = above + i;
+		dst[i] = (dstPixelType)(
+			(b[-strideY] != 0) + (b[-1] != 0) + (b[0] != 0) + (b[1] != 0) + (b[strideY] != 0) +
+			(c[-strideY - 1] != 0) + (c[-strideY] != 0) + (c[-strideY + 1] != 0) + (c[-1] != 0) +
+			(c[1] != 0) + (c[strideY - 1] != 0) + (c[strideY] != 0) + (c[strideY + 1] != 0) +
+			(a[-strideY] != 0) + (a[-1] != 0) + (a[0] != 0) + (a[1] != 0) + (a[strideY] != 0));
+	}
+}
+
+void processInteriorRow26(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType n, SizeType strideY)
+{
+	SizeType i;
+	for (i = 0; i < n; i++) {
+		const srcPixelType *b = below + i, *c = src + i, *a = above + i;
+		dst[i] = (dstPixelType)(
+			(b[-strideY - 1] != 0) + (b[-strideY] != 0) + (b[-strideY + 1] != 0) + (b[-1] != 0) + (b[0] != 0) +
+			(b[1] != 0) + (b[strideY - 1] != 0) + (b[strideY] != 0) + (b[strideY + 1] != 0) +
+			(c[-strideY - 1] != 0) + (c[-strideY] != 0) + (c[-strideY + 1] != 0) + (c[-1] != 0) +
+			(c[1] != 0) + (c[strideY - 1] != 0) + (c[strideY] != 0) + (c[strideY + 1] != 0) +
+			(a[-strideY - 1] != 0) + (a[-strideY] != 0) + (a[-strideY + 1] != 0) + (a[-1] != 0) + (a[0] != 0) +
+			(a[1] != 0) + (a[strideY - 1] != 0) + (a[strideY] != 0) + (a[strideY + 1] != 0));
+	}
+}
+
+#ifdef HAVE_X86_TARGETS
+/* Widen 32 byte counts to dstPixelType and store them at dst. */
+__attribute__((target("avx2")))
+static inline void storeCountsAvx2(dstPixelType *dst, __m256i sum)
+{
+	const __m128i low = _mm256_castsi256_si128(sum), high = _mm256_extracti128_si256(sum, 1);
+#if LABEL_BITS == 16
+	_mm256_storeu_si256((__m256i *)dst, _mm256_cvtepu8_epi16(low));
+	_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_cvtepu8_epi16(high));
+#elif LABEL_BITS == 32
+	_mm256_storeu_si256((__m256i *)dst, _mm256_cvtepu8_epi32(low));
+	_mm256_storeu_si256((__m256i *)(dst + 8), _mm256_cvtepu8_epi32(_mm_srli_si128(low, 8)));
+	_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_cvtepu8_epi32(high));
+	_mm256_storeu_si256((__m256i *)(dst + 24), _mm256_cvtepu8_epi32(_mm_srli_si128(high, 8)));
+#else
+	_mm256_storeu_si256((__m256i *)dst, _mm256_cvtepu8_epi64(low));
+	_mm256_storeu_si256((__m256i *)(dst + 4), _mm256_cvtepu8_epi64(_mm_srli_si128(low, 4)));
+	_mm256_storeu_si256((__m256i *)(dst + 8), _mm256_cvtepu8_epi64(_mm_srli_si128(low, 8)));
+	_mm256_storeu_si256((__m256i *)(dst + 12), _mm256_cvtepu8_epi64(_mm_srli_si128(low, 12)));
+	_mm256_storeu_si256((__m256i *)(dst + 16), _mm256_cvtepu8_epi64(high));
+	_mm256_storeu_si256((__m256i *)(dst + 20), _mm256_cvtepu8_epi64(_mm_srli_si128(high, 4)));
+	_mm256_storeu_si256((__m256i *)(dst + 24), _mm256_cvtepu8_epi64(_mm_srli_si128(high, 8)));
+	_mm256_storeu_si256((__m256i *)(dst + 28), _mm256_cvtepu8_epi64(_mm_srli_si128(high, 12)));
+#endif
+}
+
+/* Widen 64 byte counts to dstPixelType and store them at dst. */
+__attribute__((target("avx512bw")))
+static inline void storeCountsAvx512(dstPixelType *dst, __m512i sum)
+{
+#if LABEL_BITS == 16
+	_mm512_storeu_si512((void *)dst, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(sum)));
+	_mm512_storeu_si512((void *)(dst + 32), _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(sum, 1)));
+#elif LABEL_BITS == 32
+	_mm512_storeu_si512((void *)dst, _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(sum, 0)));
+	_mm512_storeu_si512((void *)(dst + 16), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(sum, 1)));
+	_mm512_storeu_si512((void *)(dst + 32), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(sum, 2)));
+	_mm512_storeu_si512((void *)(dst + 48), _mm512_cvtepu8_epi32(_mm512_extracti32x4_epi32(sum, 3)));
+#else
+	const __m128i lane0 = _mm512_extracti32x4_epi32(sum, 0), lane1 = _mm512_extracti32x4_epi32(sum, 1);
+	const __m128i lane2 = _mm512_extracti32x4_epi32(sum, 2), lane3 = _mm512_extracti32x4_epi32(sum, 3);
+	_mm512_storeu_si512((void *)dst, _mm512_cvtepu8_epi64(lane0));
+	_mm512_storeu_si512((void *)(dst + 8), _mm512_cvtepu8_epi64(_mm_srli_si128(lane0, 8)));
+	_mm512_storeu_si512((void *)(dst + 16), _mm512_cvtepu8_epi64(lane1));
+	_mm512_storeu_si512((void *)(dst + 24), _mm512_cvtepu8_epi64(_mm_srli_si128(lane1, 8)));
+	_mm512_storeu_si512((void *)(dst + 32), _mm512_cvtepu8_epi64(lane2));
+	_mm512_storeu_si512((void *)(dst + 40), _mm512_cvtepu8_epi64(_mm_srli_si128(lane2, 8)));
+	_mm512_storeu_si512((void *)(dst + 48), _mm512_cvtepu8_epi64(lane3));
+	_mm512_storeu_si512((void *)(dst + 56), _mm512_cvtepu8_epi64(_mm_srli_si128(lane3, 8)));
+#endif
+}
+
+/* The interior kernel with AVX2: 32 voxels per step from six unaligned loads
+   of the shifted rows. Each loaded byte is clamped to 0 or 1 with min, so any
+   nonzero source value counts once, exactly as in countNeighborsChecked. */
+__attribute__((target("avx2")))
+void processInteriorRowAvx2(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType n, SizeType strideY)
+{
+	const __m256i one = _mm256_set1_epi8(1);
+	SizeType i;
+
+	for (i = 0; i + 32 <= n; i += 32) {
+		const srcPixelType *p = src + i;
+		__m256i sum;
+
+		sum = _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(p - 1)), one);
+		sum = _mm256_add_epi8(sum, _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(p + 1)), one));
+		sum = _mm256_add_epi8(sum, _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(p - strideY)), one));
+		sum = _mm256_add_epi8(sum, _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(p + strideY)), one));
+		sum = _mm256_add_epi8(sum, _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(below + i)), one));
+		sum = _mm256_add_epi8(sum, _mm256_min_epu8(_mm256_loadu_si256((const __m256i *)(above + i)), one));
+		storeCountsAvx2(dst + i, sum);
+	}
+	processInteriorRowScalar(src + i, below + i, above + i, dst + i, n - i, strideY);
+}
+
+/* The interior kernel with AVX-512BW: 64 voxels per step. */
+__attribute__((target("avx512bw")))
+void processInteriorRowAvx512(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType n, SizeType strideY)
+{
+	const __m512i one = _mm512_set1_epi8(1);
+	SizeType i;
+
+	for (i = 0; i + 64 <= n; i += 64) {
+		const srcPixelType *p = src + i;
+		__m512i sum;
+
+		sum = _mm512_min_epu8(_mm512_loadu_si512((const void *)(p - 1)), one);
+		sum = _mm512_add_epi8(sum, _mm512_min_epu8(_mm512_loadu_si512((const void *)(p + 1)), one));
+		sum = _mm512_add_epi8(sum, _mm512_min_epu8(_mm512_loadu_si512((const void *)(p - strideY)), one));
+		sum = _mm512_add_epi8(sum, _mm512_min_epu8(_mm512_loadu_si512((const void *)(p + strideY)), one));
+		sum = _mm512_add_epi8(sum, _mm512_min_epu8(_mm512_loadu_si512((const void *)(below + i)), one));
+		sum = _mm512_add_epi8(sum, _mm512_min_epu8(_mm512_loadu_si512((const void *)(above + i)), one));
+		storeCountsAvx512(dst + i, sum);
+	}
+	processInteriorRowAvx2(src + i, below + i, above + i, dst + i, n - i, strideY);
+}
+#endif
+
+/* Pick the interior kernel for connectivity; for 6-connectivity the widest
+   one the CPU supports. */
+InteriorRowKernel selectInteriorRowKernel(int connectivity)
+{
+	if (connectivity == 18) return processInteriorRow18;
+	if (connectivity == 26) return processInteriorRow26;
+#ifdef HAVE_X86_TARGETS
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512bw")) return processInteriorRowAvx512;
+	if (__builtin_cpu_supports("avx2")) return processInteriorRowAvx2;
+#endif
+	return processInteriorRowScalar;
+}
+
+/* Count the neighbors of all voxels of row j of a plane. Rows in the interior
+   of the volume go through the branch-free interior kernel except for their
+   first and last voxel; rows on the outer shell are checked voxel by voxel. */
+void processRow(const srcPixelType *src, const srcPixelType *below, const srcPixelType *above,
+	dstPixelType *dst, SizeType j, SizeType dimX, SizeType dimY, SizeType strideY, int connectivity, InteriorRowKernel interiorRowKernel)
+{
+	SizeType i;
+
+	if (connectivity != 6) {
+		if (j >= 1 && j < dimY - 1 && below != NULL && above != NULL && dimX >= 2) {
+			dst[0] = countNeighborsCheckedConnected(src, below, above, 0, j, dimX, dimY, strideY, connectivity);
+			interiorRowKernel(src + 1, below + 1, above + 1, dst + 1, dimX - 2, strideY);
+			dst[dimX - 1] = countNeighborsCheckedConnected(src, below, above, dimX - 1, j, dimX, dimY, strideY, connectivity);
+		}
+		else {
+			for (i = 0; i < dimX; i++) {
+				dst[i] = countNeighborsCheckedConnected(src, below, above, i, j, dimX, dimY, strideY, connectivity);
+			}
+		}
+		return;
+	}
+
+	if (j >= 1 && j < dimY - 1 && below != NULL && above != NULL && dimX >= 2) {
+		dst[0] = countNeighborsChecked(src, below, above, 0, j, dimX, dimY, strideY);
+		interiorRowKernel(src + 1, below + 1, above + 1, dst + 1, dimX - 2, strideY);
+		dst[dimX - 1] = countNeighborsChecked(src, below, above, dimX - 1, j, dimX, dimY, strideY);
+	}
+	else {
+		for (i = 0; i < dimX; i++) {
+			dst[i] = countNeighborsChecked(src, below, above, i, j, dimX, dimY, strideY);
+		}
+	}
+}
+
+/* Count the nonzero neighbors of every voxel of srcVol into dstVol, with 6-,
+   18- or 26-connectivity. */
+void process(const struct Volume *srcVol, struct Volume *dstVol, int connectivity)
+{
+	const srcPixelType *srcData = (const srcPixelType *)srcVol->data;
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType dimX = srcVol->dimX, dimY = srcVol->dimY, dimZ = srcVol->dimZ;
+	const SizeType strideY = srcVol->strideY, strideZ = srcVol->strideZ;
+	const InteriorRowKernel interiorRowKernel = selectInteriorRowKernel(connectivity);
+	SizeType j, k;
+
+	checkConnectivity(connectivity);
+	if (srcVol->packing == VOLUME_PACKING_BITS) {
+		processPacked(srcVol, dstVol, connectivity);
+		return;
+	}
+	dstVol->zeroed = 0;
+
+	/* Loop (in parallel) over the destination rows, each thread writes its
+	   own rows only. */
+#pragma omp parallel for collapse(2)
+	for (k = 0; k < dimZ; k++) {
+		for (j = 0; j < dimY; j++) {
+			const srcPixelType *src = srcData + k * strideZ + j * strideY;
+
+			processRow(src, k >= 1 ? src - strideZ : NULL, k < dimZ - 1 ? src + strideZ : NULL,
+				dstData + k * dstVol->strideZ + j * dstVol->strideY, j, dimX, dimY, strideY, connectivity, interiorRowKernel);
+		}
+	} /* End of OMP parallel for. */
+}
+
+/* Sequential reader of the Z-planes of a volume file or of an ascii image, for
+   kernels that stream through volumes too large to be held in memory. */
+struct PlaneReader {
+	FILE       *fp;
+	const char *fname;
+	SizeType    dimX, dimY, dimZ;
+	int         ascii;
+	int         packing;
+	uint64_t   *words;      /* One bit-packed plane as stored in the file. */
+	SizeType    badCount;   /* Unexpected characters of an ascii image. */
+};
+
+/* Open fname for reading plane by plane. A volume file brings its own
+   dimensions; any other file is read as an ascii image of the given size. */
+void openPlaneReader(struct PlaneReader *reader, const char *fname, SizeType dimX, SizeType dimY, SizeType dimZ)
+{
+	struct VolumeFileHeader header;
+
+	reader->fname = fname;
+	reader->fp = fopen(fname, "rb");
+	if (reader->fp == NULL) {
+		printf("Failed to open %s for reading. \n", fname);
+		exit(1);
+	}
+	reader->ascii = fread(&header, sizeof(header), 1, reader->fp) != 1 ||
+		memcmp(header.magic, VOLUME_FILE_MAGIC, sizeof(header.magic)) != 0;
+	reader->packing = VOLUME_PACKING_NONE;
+	reader->words = NULL;
+	reader->badCount = 0;
+	if (reader->ascii) {
+		rewind(reader->fp);
+		reader->dimX = dimX;
+		reader->dimY = dimY;
+		reader->dimZ = dimZ;
+		return;
+	}
+	checkVolumeHeader(&header, fname, sizeof(srcPixelType));
+	reader->dimX = (SizeType)header.dimX;
+	reader->dimY = (SizeType)header.dimY;
+	reader->dimZ = (SizeType)header.dimZ;
+	reader->packing = (int)header.packing;
+	if (reader->packing == VOLUME_PACKING_BITS) {
+		reader->words = (uint64_t *)malloc((size_t)(packedRowWords(reader->dimX) * reader->dimY) * sizeof(uint64_t));
+		if (reader->words == NULL) {
+			printf("Failed to allocate a plane buffer for %s. \n", fname);
+			exit(1);
+		}
+	}
+}
+
+/* Read the next Z-plane as dimX * dimY binary voxels into plane. */
+void readPlane(struct PlaneReader *reader, srcPixelType *plane)
+{
+	const SizeType planeSize = reader->dimX * reader->dimY;
+	const SizeType rowWords = packedRowWords(reader->dimX);
+	size_t elemCnt = (size_t)(reader->packing == VOLUME_PACKING_BITS ? rowWords * reader->dimY : planeSize);
+	size_t elemRead;
+	SizeType i, j, badCount = 0;
+
+	if (reader->packing == VOLUME_PACKING_BITS) {
+		elemRead = fread(reader->words, sizeof(uint64_t), elemCnt, reader->fp);
+	}
+	else {
+		elemRead = fread(plane, sizeof(srcPixelType), elemCnt, reader->fp);
+	}
+	if (elemRead != elemCnt) {
+		printf("Failed to read a plane from %s.\n", reader->fname);
+		exit(1);
+	}
+
+	if (reader->packing == VOLUME_PACKING_BITS) {
+#pragma omp parallel for private(i)
+		for (j = 0; j < reader->dimY; j++) {
+			const uint64_t *words = reader->words + j * rowWords;
+			for (i = 0; i < reader->dimX; i++) {
+				plane[j * reader->dimX + i] = (srcPixelType)(words[i / 64] >> (i % 64) & 1);
+			}
+		}
+	}
+	else if (reader->ascii) {
+#pragma omp parallel for reduction(+:badCount)
+		for (j = 0; j < reader->dimY; j++) {
+			SizeType first;
+			badCount += asciiToBinary(plane + j * reader->dimX, reader->dimX, &first);
+		}
+		reader->badCount += badCount;
+	}
+}
+
+void closePlaneReader(struct PlaneReader *reader)
+{
+	if (reader->badCount > 0) {
+		printf("Warning: %td characters other than %d or %d encountered in %s; they were read as 0.\n",
+			reader->badCount, '0', '1', reader->fname);
+	}
+	free(reader->words);
+	fclose(reader->fp);
+}
+
+/* Compute the neighbor counts of a volume file or ascii image plane by plane,
+   holding only the source planes k - 1, k and k + 1 in a ring buffer of three
+   planes while computing plane k. Each plane of counts is written to outName
+   as soon as it is done, if outName is not NULL, and reduced into the
+   histogram sums. Memory use depends on the plane size, not on the depth. */
+void streamProcess(const char *inName, SizeType dimX, SizeType dimY, SizeType dimZ, const char *outName, int connectivity,
+	SizeType sums[MAX_NEIGHBORS + 1])
+{
+	struct PlaneReader reader;
+	struct Volume ring, dstPlane;
+	srcPixelType *planes[3];
+	const InteriorRowKernel interiorRowKernel = selectInteriorRowKernel(connectivity);
+	struct Volume hist;
+	FILE *outFp = NULL;
+	SizeType j, k, n;
+
+	openPlaneReader(&reader, inName, dimX, dimY, dimZ);
+	dimX = reader.dimX;
+	dimY = reader.dimY;
+	dimZ = reader.dimZ;
+	allocateVolume(&ring, dimX, dimY, 3, sizeof(srcPixelType));
+	allocateVolume(&dstPlane, dimX, dimY, 1, sizeof(dstPixelType));
+	for (n = 0; n < 3; n++) {
+		planes[n] = (srcPixelType *)ring.data + n * ring.strideZ;
+	}
+	if (outName != NULL) {
+		outFp = fopen(outName, "wb");
+		if (outFp == NULL) {
+			printf("Failed to open %s for writing. \n", outName);
+			exit(1);
+		}
+		writeVolumeHeader(outFp, outName, dimX, dimY, dimZ, sizeof(dstPixelType), VOLUME_PACKING_NONE);
+	}
+	checkConnectivity(connectivity);
+	allocateThreadHistograms(&hist, MAX_NEIGHBORS + 1);
+
+	readPlane(&reader, planes[0]);
+	if (dimZ > 1) readPlane(&reader, planes[1]);
+	for (k = 0; k < dimZ; k++) {
+		const srcPixelType *below = k >= 1 ? planes[(k - 1) % 3] : NULL;
+		const srcPixelType *center = planes[k % 3];
+		const srcPixelType *above = k < dimZ - 1 ? planes[(k + 1) % 3] : NULL;
+
+#pragma omp parallel for
+		for (j = 0; j < dimY; j++) {
+			dstPixelType *dst = (dstPixelType *)dstPlane.data + j * dimX;
+			SizeType *bins = threadHistogram(&hist);
+			SizeType i;
+
+			processRow(center + j * dimX, below == NULL ? NULL : below + j * dimX, above == NULL ? NULL : above + j * dimX,
+				dst, j, dimX, dimY, dimX, connectivity, interiorRowKernel);
+			for (i = 0; i < dimX; i++) {
+				bins[dst[i]]++;
+			}
+		}
+
+		if (outFp != NULL && fwrite(dstPlane.data, sizeof(dstPixelType), (size_t)(dimX * dimY), outFp) != (size_t)(dimX * dimY)) {
+			printf("Failed to write to %s.\n", outName);
+			exit(1);
+		}
+		/* Plane k - 1 is no longer needed, so plane k + 2 takes its place. */
+		if (k + 2 < dimZ) readPlane(&reader, planes[(k + 2) % 3]);
+	}
+
+	sumThreadHistograms(&hist, sums);
+	freeVolume(&hist);
+	if (outFp != NULL) fclose(outFp);
+	closePlaneReader(&reader);
+	freeVolume(&dstPlane);
+	freeVolume(&ring);
+}
+
+/*Set all the entries of dstData3D to zero*/
+void setDstToZero(struct Volume *dstVol)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	SizeType i, j, k;
+#pragma omp parallel for collapse(2) private(i)
+	for (k = 0; k < dstVol->dimZ; k++) {
+		for (j = 0; j < dstVol->dimY; j++) {
+			dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			for (i = 0; i < dstVol->dimX; i++) {
+				dst[i] = 0;
+			}
+		}
+	}
+	dstVol->zeroed = 1;
+}
+
+/*Set all the entries of dstData3D to those of srcData3D, which may be bit-packed*/
+void setDstToSource(const struct Volume *srcVol, struct Volume *dstVol)
+{
+	const srcPixelType *srcData = (const srcPixelType *)srcVol->data;
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	SizeType i, j, k;
+
+	dstVol->zeroed = 0;
+	if (srcVol->packing == VOLUME_PACKING_BITS) {
+#pragma omp parallel for collapse(2) private(i)
+		for (k = 0; k < dstVol->dimZ; k++) {
+			for (j = 0; j < dstVol->dimY; j++) {
+				const uint64_t *words = (const uint64_t *)srcVol->data + k * srcVol->strideZ + j * srcVol->strideY;
+				dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+				for (i = 0; i < dstVol->dimX; i++) {
+					dst[i] = (dstPixelType)(words[i / 64] >> (i % 64) & 1);
+				}
+			}
+		}
+		return;
+	}
+#pragma omp parallel for collapse(2) private(i)
+	for (k = 0; k < dstVol->dimZ; k++) {
+		for (j = 0; j < dstVol->dimY; j++) {
+			const srcPixelType *src = srcData + k * srcVol->strideZ + j * srcVol->strideY;
+			dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			for (i = 0; i < dstVol->dimX; i++) {
+				dst[i] = src[i];
+			}
+		}
+	}
+}
+
+/* Get dstVol ready for the flood fills to label srcVol: the flood fills read
+   the object voxels from srcVol, which may be bit-packed and have strides of
+   its own, and need dstVol zeroed. A dstVol allocated by
+   allocateZeroedVolume, and not written since, is left as it is, so
+   labeling a fresh volume writes every label page only once; a dstVol that
+   was used before is zeroed with setDstToZero. A NULL srcVol means dstVol
+   holds a copy of the image already, with 1 on the object voxels. */
+void prepareFloodSource(const struct Volume *srcVol, struct Volume *dstVol)
+{
+	if (srcVol != NULL && !dstVol->zeroed) setDstToZero(dstVol);
+	dstVol->zeroed = 0;
+}
+
+/* Print a histogram of connections given as the number of pixels having 0 to
+   connectivity neighbors. */
+void printNeighborHistogram(const SizeType sums[MAX_NEIGHBORS + 1], int connectivity)
+{
+	SizeType n, total = 0;
+
+	for (n = 0; n <= connectivity; n++) {
+		printf("The number of pixels having %td neighbor%s is: %td.\n", n, n == 1 ? " " : "s", sums[n]);
+		total += sums[n];
+	}
+	printf("Total: %td. \n", total);
+}
+
+/* Function to provide some output based on the destination image. We
+   give a histogram of connections. */
+void someOutput(const struct Volume *dstVol, int connectivity)
+{
+	const dstPixelType *dstData = (const dstPixelType *)dstVol->data;
+	SizeType sums[MAX_NEIGHBORS + 1];
+	struct Volume hist;
+	SizeType i, j, k;
+	SizeType badCount = 0, firstBad = PTRDIFF_MAX;
+
+	/* Every thread counts into its own histogram, and the histograms are
+	   added up once all threads are done. Unexpected values are counted
+	   and reported once afterwards. */
+	allocateThreadHistograms(&hist, connectivity + 1);
+
+#pragma omp parallel for collapse(2) private(i) reduction(+:badCount) reduction(min:firstBad)
+	for (k = 0; k < dstVol->dimZ; k++) {
+		for (j = 0; j < dstVol->dimY; j++) {
+			const dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			SizeType *bins = threadHistogram(&hist);
+			for (i = 0; i < dstVol->dimX; i++) {
+				dstPixelType neighborCnt = dst[i];
+				if (neighborCnt <= (dstPixelType)connectivity) {
+					bins[neighborCnt]++;
+				}
+				else {
+					const SizeType inx = (k * dstVol->dimY + j) * dstVol->dimX + i;
+					badCount++;
+					if (inx < firstBad) firstBad = inx;
+				}
+			}
+		}
+	} /* End of OMP parallel for. */
+
+	if (badCount > 0) {
+		printf("Warning: %td unexpected values encountered, the first at index %td, %td, %td.\n", badCount,
+			firstBad % dstVol->dimX, (firstBad / dstVol->dimX) % dstVol->dimY, firstBad / (dstVol->dimX * dstVol->dimY));
+	}
+	sumThreadHistograms(&hist, sums);
+	freeVolume(&hist);
+	printNeighborHistogram(sums, connectivity);
+}
+
+/* Row buffer of neighbor counts of the calling thread. Like the flood fill
+   stacks it is kept, at the longest length asked for, for later calls on
+   that thread. NULL when memory runs out. */
+static dstPixelType *threadRowBuffer = NULL;
+static SizeType threadRowLength = 0;
+#pragma omp threadprivate(threadRowBuffer, threadRowLength)
+
+dstPixelType *getThreadRowBuffer(SizeType length)
+{
+	if (length > threadRowLength) {
+		dstPixelType *row = (dstPixelType *)realloc(threadRowBuffer, length * sizeof(dstPixelType));
+		if (row == NULL) return NULL;
+		threadRowBuffer = row;
+		threadRowLength = length;
+	}
+	return threadRowBuffer;
+}
+
+/* neighborHistogram for an unpacked srcVol, counting into hist, thread
+   histograms allocated by allocateThreadHistograms with at least
+   connectivity + 1 bins, which are cleared first. Return 0, or
+   LABELING_ERROR_MEMORY when a row buffer could not be allocated. */
+SizeType neighborHistogramWith(const struct Volume *srcVol, SizeType sums[MAX_NEIGHBORS + 1], int connectivity, struct Volume *hist)
+{
+	const srcPixelType *srcData = (const srcPixelType *)srcVol->data;
+	const SizeType dimX = srcVol->dimX, dimY = srcVol->dimY, dimZ = srcVol->dimZ;
+	const SizeType strideY = srcVol->strideY, strideZ = srcVol->strideZ;
+	const InteriorRowKernel interiorRowKernel = selectInteriorRowKernel(connectivity);
+	SizeType n, result = 0;
+
+	memset(hist->data, 0, (size_t)(hist->strideZ) * sizeof(SizeType));
+	hist->dimX = connectivity + 1;
+
+#pragma omp parallel
+	{
+		SizeType *bins = threadHistogram(hist);
+		dstPixelType *row = getThreadRowBuffer(dimX);
+		SizeType i, j, k;
+
+		if (row == NULL) {
+#pragma omp atomic write
+			result = LABELING_ERROR_MEMORY;
+		}
+#pragma omp for collapse(2)
+		for (k = 0; k < dimZ; k++) {
+			for (j = 0; j < dimY; j++) {
+				const srcPixelType *src = srcData + k * strideZ + j * strideY;
+
+				if (row == NULL) continue;
+				processRow(src, k >= 1 ? src - strideZ : NULL, k < dimZ - 1 ? src + strideZ : NULL,
+					row, j, dimX, dimY, strideY, connectivity, interiorRowKernel);
+				for (i = 0; i < dimX; i++) {
+					bins[row[i]]++;
+				}
+			}
+		}
+	}
+
+	for (n = 0; n <= MAX_NEIGHBORS; n++) sums[n] = 0;
+	sumThreadHistograms(hist, sums);
+	return result;
+}
+
+/* Compute the histogram of connections of the source image, the number of
+   voxels having 0 to connectivity neighbors, without a destination image:
+   every row of neighbor counts is computed into a buffer of the thread and
+   counted right away, while it is still in cache. */
+void neighborHistogram(const struct Volume *srcVol, SizeType sums[MAX_NEIGHBORS + 1], int connectivity)
+{
+	struct Volume hist;
+
+	checkConnectivity(connectivity);
+	if (srcVol->packing == VOLUME_PACKING_BITS) {
+		neighborHistogramPacked(srcVol, sums, connectivity);
+		return;
+	}
+	allocateThreadHistograms(&hist, connectivity + 1);
+	checkLabelingResult(neighborHistogramWith(srcVol, sums, connectivity, &hist));
+	freeVolume(&hist);
+}
+
+/* Give the same histogram of connections as someOutput, computed straight
+   from a bit-packed source image. */
+void someOutputPacked(const struct Volume *bitVol, int connectivity)
+{
+	SizeType sums[MAX_NEIGHBORS + 1];
+
+	neighborHistogramPacked(bitVol, sums, connectivity);
+	printNeighborHistogram(sums, connectivity);
+}
+
+/* Give the same histogram of connections as someOutput, computed straight
+   from the source image with neighborHistogram, so the neighbor counts are
+   never stored. */
+void someOutputFused(const struct Volume *srcVol, int connectivity)
+{
+	SizeType sums[MAX_NEIGHBORS + 1];
+
+	neighborHistogram(srcVol, sums, connectivity);
+	printNeighborHistogram(sums, connectivity);
+}
+
+
+
+/* Work stack of the flood fill of the calling thread, and the stack of label
+   pairs the block engine gathers on it, which relabelEdits also uses for the
+   voxels it clears. Each is created on first use and
+   then kept, together with the capacity it has grown to, for all later
+   objects and calls on that thread, so neither allocates memory in the
+   common case. They are NULL when memory runs out. */
+static struct Stack *threadFloodStack = NULL, *threadPairStack = NULL;
+#pragma omp threadprivate(threadFloodStack, threadPairStack)
+
+struct Stack *keepStack(struct Stack **stack)
+{
+	if (*stack == NULL) *stack = createStack(STACK_INITIAL_SIZE);
+	return *stack;
+}
+
+struct Stack *getThreadStack(void)
+{
+	return keepStack(&threadFloodStack);
+}
+
+struct Stack *getThreadPairStack(void)
+{
+	return keepStack(&threadPairStack);
+}
+
+/* Free the flood fill stacks and the row buffer kept by every thread of a
+   team of omp_get_max_threads() threads, the largest team the engines run
+   on, the calling thread included. Threads that need them again create
+   them anew. */
+void releaseThreadBuffers(void)
+{
+#pragma omp parallel
+	{
+		destroyStack(threadFloodStack);
+		destroyStack(threadPairStack);
+		free(threadRowBuffer);
+		threadFloodStack = NULL;
+		threadPairStack = NULL;
+		threadRowBuffer = NULL;
+		threadRowLength = 0;
+	}
+}
+
+/* An axis-aligned box of voxels, [iMin, iMax) x [jMin, jMax) x [kMin, kMax). */
+struct Box {
+	SizeType iMin, iMax, jMin, jMax, kMin, kMax;
+};
+
+/* Running statistics of one object while it is labeled: its number of
+   voxels, its bounding box, inclusive, and the sums of its voxel coordinates,
+   from which its centroid follows. */
+struct ObjectAccumulator {
+	SizeType voxelCount;
+	SizeType iMin, iMax, jMin, jMax, kMin, kMax;
+	SizeType iSum, jSum, kSum;
+};
+
+void resetAccumulator(struct ObjectAccumulator *acc)
+{
+	acc->voxelCount = 0;
+	acc->iMin = acc->jMin = acc->kMin = PTRDIFF_MAX;
+	acc->iMax = acc->jMax = acc->kMax = -1;
+	acc->iSum = acc->jSum = acc->kSum = 0;
+}
+
+/* Add voxels iStart up to, but not including, iEnd of row (j, k). */
+static inline void accumulateRun(struct ObjectAccumulator *acc, SizeType iStart, SizeType iEnd, SizeType j, SizeType k)
+{
+	const SizeType n = iEnd - iStart;
+
+	acc->voxelCount += n;
+	acc->iSum += (iStart + iEnd - 1) * n / 2;
+	acc->jSum += j * n;
+	acc->kSum += k * n;
+	if (iStart < acc->iMin) acc->iMin = iStart;
+	if (iEnd - 1 > acc->iMax) acc->iMax = iEnd - 1;
+	if (j < acc->jMin) acc->jMin = j;
+	if (j > acc->jMax) acc->jMax = j;
+	if (k < acc->kMin) acc->kMin = k;
+	if (k > acc->kMax) acc->kMax = k;
+}
+
+void mergeAccumulator(struct ObjectAccumulator *into, const struct ObjectAccumulator *from)
+{
+	into->voxelCount += from->voxelCount;
+	into->iSum += from->iSum;
+	into->jSum += from->jSum;
+	into->kSum += from->kSum;
+	if (from->iMin < into->iMin) into->iMin = from->iMin;
+	if (from->iMax > into->iMax) into->iMax = from->iMax;
+	if (from->jMin < into->jMin) into->jMin = from->jMin;
+	if (from->jMax > into->jMax) into->jMax = from->jMax;
+	if (from->kMin < into->kMin) into->kMin = from->kMin;
+	if (from->kMax > into->kMax) into->kMax = from->kMax;
+}
+
+/* Grow or shrink the arrays of stats to capacity entries. Return 0 when
+   memory runs out, leaving the capacity of stats as it was, and 1
+   otherwise. */
+int resizeObjectStats(struct ObjectStats *stats, SizeType capacity)
+{
+	SizeType **counts[] = { &stats->voxelCount, &stats->iMin, &stats->iMax, &stats->jMin, &stats->jMax, &stats->kMin, &stats->kMax };
+	double **centroids[] = { &stats->iCentroid, &stats->jCentroid, &stats->kCentroid };
+	const size_t n = capacity > 0 ? (size_t)capacity : 1;
+	size_t a;
+
+	for (a = 0; a < sizeof(counts) / sizeof(counts[0]); a++) {
+		SizeType *p = (SizeType *)realloc(*counts[a], n * sizeof(SizeType));
+		if (p == NULL) return 0;
+		*counts[a] = p;
+	}
+	for (a = 0; a < sizeof(centroids) / sizeof(centroids[0]); a++) {
+		double *p = (double *)realloc(*centroids[a], n * sizeof(double));
+		if (p == NULL) return 0;
+		*centroids[a] = p;
+	}
+	stats->capacity = capacity;
+	return 1;
+}
+
+/* resizeObjectStats that exits when memory runs out. */
+void growObjectStats(struct ObjectStats *stats, SizeType capacity)
+{
+	if (!resizeObjectStats(stats, capacity)) {
+		printf("Failed to allocate statistics for %td objects. \n", capacity);
+		exit(1);
+	}
+}
+
+/* Make stats an empty table with room for capacity objects. */
+void allocateObjectStats(struct ObjectStats *stats, SizeType capacity)
+{
+	memset(stats, 0, sizeof(*stats));
+	growObjectStats(stats, capacity);
+}
+
+/* Empty stats, a table allocated before or zeroed, keeping its arrays unless
+   they have less room than capacity objects. Return 0 when memory runs out,
+   see resizeObjectStats, and 1 otherwise. */
+int reserveObjectStats(struct ObjectStats *stats, SizeType capacity)
+{
+	stats->objectCount = 0;
+	if (stats->voxelCount == NULL || capacity > stats->capacity) {
+		return resizeObjectStats(stats, capacity);
+	}
+	return 1;
+}
+
+void freeObjectStats(struct ObjectStats *stats)
+{
+	free(stats->voxelCount);
+	free(stats->iMin);
+	free(stats->iMax);
+	free(stats->jMin);
+	free(stats->jMax);
+	free(stats->kMin);
+	free(stats->kMax);
+	free(stats->iCentroid);
+	free(stats->jCentroid);
+	free(stats->kCentroid);
+	memset(stats, 0, sizeof(*stats));
+}
+
+/* Store the statistics of acc as entry n of stats. */
+void setObjectStats(struct ObjectStats *stats, SizeType n, const struct ObjectAccumulator *acc)
+{
+	stats->voxelCount[n] = acc->voxelCount;
+	stats->iMin[n] = acc->iMin;
+	stats->iMax[n] = acc->iMax;
+	stats->jMin[n] = acc->jMin;
+	stats->jMax[n] = acc->jMax;
+	stats->kMin[n] = acc->kMin;
+	stats->kMax[n] = acc->kMax;
+	stats->iCentroid[n] = (double)acc->iSum / (double)acc->voxelCount;
+	stats->jCentroid[n] = (double)acc->jSum / (double)acc->voxelCount;
+	stats->kCentroid[n] = (double)acc->kSum / (double)acc->voxelCount;
+}
+
+/* Append the statistics of acc as the next object of stats. */
+void appendObjectStats(struct ObjectStats *stats, const struct ObjectAccumulator *acc)
+{
+	if (stats->objectCount == stats->capacity) {
+		growObjectStats(stats, 2 * stats->capacity + 64);
+	}
+	setObjectStats(stats, stats->objectCount, acc);
+	stats->objectCount++;
+}
+
+/* Reset the nThreads tables of objectCount accumulators of threadAcc. */
+void resetThreadAccumulators(struct ObjectAccumulator *threadAcc, int nThreads, SizeType objectCount)
+{
+	const SizeType n = (SizeType)nThreads * objectCount;
+	SizeType x;
+
+#pragma omp parallel for schedule(static)
+	for (x = 0; x < n; x++) {
+		resetAccumulator(&threadAcc[x]);
+	}
+}
+
+/* Whether nThreads tables of objectCount accumulators, of 80 bytes each,
+   take no more memory than the labels of voxelCount voxels. With many small
+   objects they can take far more: 500000 objects on 64 threads need 2.5 GB.
+   The engines then gather the statistics in a single shared table instead. */
+int threadAccumulatorsFit(int nThreads, SizeType objectCount, SizeType voxelCount)
+{
+	return (double)nThreads * (double)objectCount * sizeof(struct ObjectAccumulator) <= (double)voxelCount * sizeof(dstPixelType);
+}
+
+/* One table of objectCount accumulators per thread, so the threads of a
+   parallel pass each add to their own. The tables take nThreads *
+   objectCount * sizeof(struct ObjectAccumulator) bytes, see
+   threadAccumulatorsFit. */
+struct ObjectAccumulator *allocateThreadAccumulators(int nThreads, SizeType objectCount)
+{
+	const SizeType n = (SizeType)nThreads * objectCount;
+	struct ObjectAccumulator *threadAcc;
+
+	threadAcc = (struct ObjectAccumulator *)malloc((n > 0 ? n : 1) * sizeof(struct ObjectAccumulator));
+	if (threadAcc == NULL) {
+		printf("Failed to allocate statistics for %td objects. \n", objectCount);
+		exit(1);
+	}
+	resetThreadAccumulators(threadAcc, nThreads, objectCount);
+	return threadAcc;
+}
+
+/* Merge the per-thread tables of threadAcc, in parallel over the objects,
+   into the first objectCount entries of stats, which has room for them. */
+void mergeThreadAccumulatorsInto(struct ObjectAccumulator *threadAcc, int nThreads, SizeType objectCount, struct ObjectStats *stats)
+{
+	SizeType n;
+
+#pragma omp parallel for schedule(static)
+	for (n = 0; n < objectCount; n++) {
+		int t;
+		for (t = 1; t < nThreads; t++) {
+			mergeAccumulator(&threadAcc[n], &threadAcc[(SizeType)t * objectCount + n]);
+		}
+		setObjectStats(stats, n, &threadAcc[n]);
+	}
+	stats->objectCount = objectCount;
+}
+
+/* Merge the per-thread tables of threadAcc into stats, which is (re)allocated
+   for objectCount objects, and free them. */
+void mergeThreadAccumulators(struct ObjectAccumulator *threadAcc, int nThreads, SizeType objectCount, struct ObjectStats *stats)
+{
+	allocateObjectStats(stats, objectCount);
+	mergeThreadAccumulatorsInto(threadAcc, nThreads, objectCount, stats);
+	free(threadAcc);
+}
+
+/* Gather the statistics of the objectCount objects of labelVol, labeled 2 up
+   to objectCount + 1, into stats, which is allocated here, in a pass over the
+   labels of its own: the pass that engines gathering the statistics while
+   they label save. Every run of equal labels along X is added to the
+   accumulator of its object in the table of the thread, see
+   threadAccumulatorsFit. */
+void labelStats(const struct Volume *labelVol, SizeType objectCount, struct ObjectStats *stats)
+{
+	const dstPixelType *data = (const dstPixelType *)labelVol->data;
+	const SizeType dimX = labelVol->dimX, dimY = labelVol->dimY, nRows = labelVol->dimY * labelVol->dimZ;
+	const int nThreads = threadAccumulatorsFit(omp_get_max_threads(), objectCount, dimX * nRows) ? omp_get_max_threads() : 1;
+	struct ObjectAccumulator *threadAcc = allocateThreadAccumulators(nThreads, objectCount);
+	SizeType row;
+
+#pragma omp parallel num_threads(nThreads)
+	{
+		struct ObjectAccumulator *acc = threadAcc + (SizeType)omp_get_thread_num() * objectCount;
+
+#pragma omp for schedule(static)
+		for (row = 0; row < nRows; row++) {
+			const dstPixelType *labels = data + (row / dimY) * labelVol->strideZ + (row % dimY) * labelVol->strideY;
+			SizeType runLabel = 0, runStart = 0, i;
+
+			for (i = 0; i < dimX; i++) {
+				if ((SizeType)labels[i] != runLabel) {
+					if (runLabel != 0) accumulateRun(acc + runLabel - 2, runStart, i, row % dimY, row / dimY);
+					runLabel = (SizeType)labels[i];
+					runStart = i;
+				}
+			}
+			if (runLabel != 0) accumulateRun(acc + runLabel - 2, runStart, dimX, row % dimY, row / dimY);
+		}
+	}
+	mergeThreadAccumulators(threadAcc, nThreads, objectCount, stats);
+}
+
+/* Print the statistics of the first maxObjects objects of stats. */
+void printObjectStats(const struct ObjectStats *stats, SizeType maxObjects)
+{
+	SizeType n;
+
+	printf("Statistics of %td objects:\n", stats->objectCount);
+	for (n = 0; n < stats->objectCount && n < maxObjects; n++) {
+		printf("Label %td: %td voxels, box [%td, %td] x [%td, %td] x [%td, %td], centroid (%.2f, %.2f, %.2f)\n", n + 2, stats->voxelCount[n],
+			stats->iMin[n], stats->iMax[n], stats->jMin[n], stats->jMax[n], stats->kMin[n], stats->kMax[n],
+			stats->iCentroid[n], stats->jCentroid[n], stats->kCentroid[n]);
+	}
+	if (n < stats->objectCount) {
+		printf("...\n");
+	}
+}
+
+/* A flood fill engine: floods the object containing voxel (i, j, k), which
+   the caller has already labeled, with label without leaving box. Unless acc
+   is NULL, every voxel of the object, including (i, j, k), is added to it.
+   When srcVol is NULL the destination holds a copy of the image, with 1 on
+   the unlabeled object voxels; otherwise the object voxels are read from
+   srcVol, which may be bit-packed and have strides other than those of the
+   destination, and the destination starts zeroed. */
+typedef void (*FloodFillInBox)(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label,
+	struct Stack *stack, struct ObjectAccumulator *acc, const struct Volume *srcVol);
+
+/* Where the flood fills find the object voxels: in the destination, in an
+   unpacked source volume laid out like the destination, in an unpacked one
+   with other strides, or in a bit-packed one. */
+#define FLOOD_FROM_LABELS 0
+#define FLOOD_FROM_BYTES 1
+#define FLOOD_FROM_STRIDED_BYTES 2
+#define FLOOD_FROM_BITS 3
+
+/* Whether voxel n of the destination, which is voxel x of the source row
+   starting at element srcRow of srcData, the data of the source volume, is
+   an object voxel. A source laid out like the destination is indexed with n
+   directly. */
+static forceinline int sourceVoxel(const void *srcData, SizeType n, SizeType srcRow, SizeType x, const int fromSource)
+{
+	if (fromSource == FLOOD_FROM_BITS) return (int)(((const uint64_t *)srcData)[srcRow + (SizeType)((size_t)x / 64)] >> ((size_t)x % 64) & 1);
+	if (fromSource == FLOOD_FROM_STRIDED_BYTES) return ((const srcPixelType *)srcData)[srcRow + x] != 0;
+	return ((const srcPixelType *)srcData)[n] != 0;
+}
+
+/* The source of a flood fill core, kept in locals so that it is not read
+   from srcVol again after every push, and the first element of its row
+   (j, k), which only sources with strides of their own need. */
+#define SOURCE_LOCALS \
+	const void *srcData = fromSource ? srcVol->data : NULL; \
+	const SizeType srcStrideY = fromSource ? srcVol->strideY : 0, srcStrideZ = fromSource ? srcVol->strideZ : 0
+#define SOURCE_ROW(j, k) (fromSource >= FLOOD_FROM_STRIDED_BYTES ? (k) * srcStrideZ + (j) * srcStrideY : 0)
+
+/* Whether voxel n of the destination, voxel x of the source row at srcRow,
+   is an object voxel that is not labeled yet. Each flood fill below is an
+   inline core taking a constant fromSource, so that the wrappers, which
+   pick the core once per object, get a copy for each kind of source
+   without the tests of the others. A bit is dearer to extract than a label
+   is to load, so for packed sources the label is tested first: inside an
+   object most neighbors are labeled already. */
+#define UNLABELED(n, srcRow, x) (fromSource == FLOOD_FROM_BITS ? dstData[n] == 0 && sourceVoxel(srcData, n, srcRow, x, fromSource) : \
+	fromSource ? sourceVoxel(srcData, n, srcRow, x, fromSource) && dstData[n] == 0 : dstData[n] == 1)
+
+/* Call core, an inline flood fill, with the fromSource of srcVol and dstVol. */
+#define CALL_WITH_SOURCE(core, ...) \
+	do { \
+		if (srcVol == NULL) core(__VA_ARGS__, NULL, FLOOD_FROM_LABELS); \
+		else if (srcVol->packing == VOLUME_PACKING_BITS) core(__VA_ARGS__, srcVol, FLOOD_FROM_BITS); \
+		else if (srcVol->strideY == dstVol->strideY && srcVol->strideZ == dstVol->strideZ) core(__VA_ARGS__, srcVol, FLOOD_FROM_BYTES); \
+		else core(__VA_ARGS__, srcVol, FLOOD_FROM_STRIDED_BYTES); \
+	} while (0)
+
+/* Flood the object containing voxel (i, j, k) with label, without leaving box.
+   The stack holds linear voxel indices, from which the coordinates are
+   recovered for the bounds checks. */
+static forceinline void singlePassDFSInBoxFaces(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label,
+	struct Stack *stack, struct ObjectAccumulator *acc, const struct Volume *srcVol, const int fromSource)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType strideY = dstVol->strideY, strideZ = dstVol->strideZ;
+	SOURCE_LOCALS;
+
+	push(stack, k * strideZ + j * strideY + i);
+	while (!isEmpty(stack))
+	{
+		SizeType inx = pop(stack);
+		SizeType srcRow;
+
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		srcRow = SOURCE_ROW(j, k);
+		if (acc != NULL) accumulateRun(acc, i, i + 1, j, k);
+		if (i > box->iMin) {
+			if (UNLABELED(inx - 1, srcRow, i - 1)) //Voxel is object voxel and not yet labeled.
+			{
+				dstData[inx - 1] = label;
+				push(stack, inx - 1);
+			}
+		}
+		if (i < box->iMax - 1) {
+			if (UNLABELED(inx + 1, srcRow, i + 1)) //Voxel is object voxel and not yet labeled.
+			{
+				dstData[inx + 1] = label;
+				push(stack, inx + 1);
+			}
+		}
+
+		if (j > box->jMin) {
+			if (UNLABELED(inx - strideY, srcRow - srcStrideY, i)) //Voxel is object voxel and not yet labeled.
+			{
+				dstData[inx - strideY] = label;
+				push(stack, inx - strideY);
+			}
+		}
+		if (j < box->jMax - 1) {
+			if (UNLABELED(inx + strideY, srcRow + srcStrideY, i)) //Voxel is object voxel and not yet labeled.
+			{
+				dstData[inx + strideY] = label;
+				push(stack, inx + strideY);
+			}
+		}
+
+		if (k > box->kMin) {
+			if (UNLABELED(inx - strideZ, srcRow - srcStrideZ, i)) //Voxel is object voxel and not yet labeled.
+			{
+				dstData[inx - strideZ] = label;
+				push(stack, inx - strideZ);
+			}
+		}
+		if (k < box->kMax - 1) {
+			if (UNLABELED(inx + strideZ, srcRow + srcStrideZ, i)) //Voxel is object voxel and not yet labeled.
+			{
+				dstData[inx + strideZ] = label;
+				push(stack, inx + strideZ);
+			}
+		}
+	}
+}
+
+void singlePassDFSInBox(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack,
+	struct ObjectAccumulator *acc, const struct Volume *srcVol)
+{
+	CALL_WITH_SOURCE(singlePassDFSInBoxFaces, dstVol, box, i, j, k, label, stack, acc);
+}
+
+void singlePassDFS(struct Volume *dstVol, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack)
+{
+	const struct Box wholeImage = { 0, dstVol->dimX, 0, dstVol->dimY, 0, dstVol->dimZ };
+	singlePassDFSInBox(dstVol, &wholeImage, i, j, k, label, stack, NULL, NULL);
+}
+
+/* Seed the unlabeled runs among voxels iFrom to iTo of the row at inx, whose
+   source row is at srcRow: the first voxel of each run is labeled and
+   pushed, the rest of the run is filled when that seed is popped. */
+static forceinline void seedRowSpans(dstPixelType *dstData, SizeType inx, SizeType srcRow, SizeType iFrom, SizeType iTo, dstPixelType label,
+	struct Stack *stack, const void *srcData, const int fromSource)
+{
+	SizeType i;
+	int inRun = 0;
+
+	for (i = iFrom; i <= iTo; i++) {
+		if (UNLABELED(inx + i, srcRow, i)) {
+			if (!inRun) {
+				dstData[inx + i] = label;
+				push(stack, inx + i);
+				inRun = 1;
+			}
+		}
+		else {
+			inRun = 0;
+		}
+	}
+}
+
+/* Flood the object containing voxel (i, j, k) with label, without leaving box,
+   one span at a time. Each popped seed is extended left and right along X to
+   the whole run it lies in, and only the first voxel of every unlabeled run
+   touching the span in the rows and planes next to it is pushed. A drop-in
+   replacement for singlePassDFSInBox. */
+static forceinline void spanFillInBoxFaces(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label,
+	struct Stack *stack, struct ObjectAccumulator *acc, const struct Volume *srcVol, const int fromSource)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType strideY = dstVol->strideY, strideZ = dstVol->strideZ;
+	SOURCE_LOCALS;
+
+	push(stack, k * strideZ + j * strideY + i);
+	while (!isEmpty(stack))
+	{
+		SizeType inx = pop(stack);
+		SizeType row, srcRow, iLeft, iRight;
+
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		row = inx - i;
+		srcRow = SOURCE_ROW(j, k);
+
+		/* Fill the run of the seed. */
+		for (iLeft = i; iLeft > box->iMin && UNLABELED(row + iLeft - 1, srcRow, iLeft - 1); iLeft--) {
+			dstData[row + iLeft - 1] = label;
+		}
+		for (iRight = i; iRight < box->iMax - 1 && UNLABELED(row + iRight + 1, srcRow, iRight + 1); iRight++) {
+			dstData[row + iRight + 1] = label;
+		}
+		if (acc != NULL) accumulateRun(acc, iLeft, iRight + 1, j, k);
+
+		if (j > box->jMin) seedRowSpans(dstData, row - strideY, srcRow - srcStrideY, iLeft, iRight, label, stack, srcData, fromSource);
+		if (j < box->jMax - 1) seedRowSpans(dstData, row + strideY, srcRow + srcStrideY, iLeft, iRight, label, stack, srcData, fromSource);
+		if (k > box->kMin) seedRowSpans(dstData, row - strideZ, srcRow - srcStrideZ, iLeft, iRight, label, stack, srcData, fromSource);
+		if (k < box->kMax - 1) seedRowSpans(dstData, row + strideZ, srcRow + srcStrideZ, iLeft, iRight, label, stack, srcData, fromSource);
+	}
+}
+
+void spanFillInBox(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack,
+	struct ObjectAccumulator *acc, const struct Volume *srcVol)
+{
+	CALL_WITH_SOURCE(spanFillInBoxFaces, dstVol, box, i, j, k, label, stack, acc);
+}
+
+/* Offsets (di, dj, dk) of the neighbors of a voxel: the first 6 share a face
+   with it, the next 12 an edge and the last 8 a corner, so the neighbors with
+   connectivity c are the first c entries. */
+static const signed char neighborOffsets[MAX_NEIGHBORS][3] = {
+	{ -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 },
+	{ -1, -1, 0 }, { 1, -1, 0 }, { -1, 1, 0 }, { 1, 1, 0 },
+	{ -1, 0, -1 }, { 1, 0, -1 }, { -1, 0, 1 }, { 1, 0, 1 },
+	{ 0, -1, -1 }, { 0, 1, -1 }, { 0, -1, 1 }, { 0, 1, 1 },
+	{ -1, -1, -1 }, { 1, -1, -1 }, { -1, 1, -1 }, { 1, 1, -1 },
+	{ -1, -1, 1 }, { 1, -1, 1 }, { -1, 1, 1 }, { 1, 1, 1 }
+};
+
+/* singlePassDFSInBox for 18- or 26-connectivity. The neighbors are the first
+   connectivity entries of neighborOffsets, turned into index offsets, in the
+   destination and between source rows, once per object. A voxel that is not
+   on a face of box has all of them inside, so its neighbors are visited
+   without bounds checks; only voxels on the faces test every neighbor
+   against box. */
+static forceinline void singlePassDFSInBoxConnected(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k,
+	dstPixelType label, struct Stack *stack, struct ObjectAccumulator *acc, const int connectivity, const struct Volume *srcVol,
+	const int fromSource)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType strideY = dstVol->strideY, strideZ = dstVol->strideZ;
+	SOURCE_LOCALS;
+	SizeType offsets[MAX_NEIGHBORS], srcRowOffsets[MAX_NEIGHBORS];
+	int n;
+
+	for (n = 0; n < connectivity; n++) {
+		offsets[n] = neighborOffsets[n][0] + neighborOffsets[n][1] * strideY + neighborOffsets[n][2] * strideZ;
+		srcRowOffsets[n] = SOURCE_ROW(neighborOffsets[n][1], neighborOffsets[n][2]);
+	}
+	push(stack, k * strideZ + j * strideY + i);
+	while (!isEmpty(stack))
+	{
+		SizeType inx = pop(stack);
+		SizeType srcRow;
+
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		srcRow = SOURCE_ROW(j, k);
+		if (acc != NULL) accumulateRun(acc, i, i + 1, j, k);
+		if (i > box->iMin && i < box->iMax - 1 && j > box->jMin && j < box->jMax - 1 && k > box->kMin && k < box->kMax - 1) {
+			for (n = 0; n < connectivity; n++) {
+				const SizeType m = inx + offsets[n];
+				if (UNLABELED(m, srcRow + srcRowOffsets[n], i + neighborOffsets[n][0])) //Voxel is object voxel and not yet labeled.
+				{
+					dstData[m] = label;
+					push(stack, m);
+				}
+			}
+		}
+		else {
+			for (n = 0; n < connectivity; n++) {
+				const SizeType m = inx + offsets[n];
+				if (i + neighborOffsets[n][0] < box->iMin || i + neighborOffsets[n][0] >= box->iMax ||
+					j + neighborOffsets[n][1] < box->jMin || j + neighborOffsets[n][1] >= box->jMax ||
+					k + neighborOffsets[n][2] < box->kMin || k + neighborOffsets[n][2] >= box->kMax) continue;
+				if (UNLABELED(m, srcRow + srcRowOffsets[n], i + neighborOffsets[n][0])) //Voxel is object voxel and not yet labeled.
+				{
+					dstData[m] = label;
+					push(stack, m);
+				}
+			}
+		}
+	}
+}
+
+void singlePassDFSInBox18(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack,
+	struct ObjectAccumulator *acc, const struct Volume *srcVol)
+{
+	CALL_WITH_SOURCE(singlePassDFSInBoxConnected, dstVol, box, i, j, k, label, stack, acc, 18);
+}
+
+void singlePassDFSInBox26(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack,
+	struct ObjectAccumulator *acc, const struct Volume *srcVol)
+{
+	CALL_WITH_SOURCE(singlePassDFSInBoxConnected, dstVol, box, i, j, k, label, stack, acc, 26);
+}
+
+/* Rows (dj, dk) next to a span whose runs can touch it: the first four share
+   a face with the row of the span, the last four an edge. */
+static const signed char neighborRows[8][2] = {
+	{ -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 },
+	{ -1, -1 }, { 1, -1 }, { -1, 1 }, { 1, 1 }
+};
+
+/* spanFillInBox for 18- or 26-connectivity: besides the rows above and below
+   and the planes in front and behind, the four diagonal rows of neighborRows
+   are searched. With both connectivities the four face rows are searched one
+   voxel beyond both ends of the span, as voxels diagonal along X are
+   neighbors; with 26-connectivity the diagonal rows are too. */
+static forceinline void spanFillInBoxConnected(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k,
+	dstPixelType label, struct Stack *stack, struct ObjectAccumulator *acc, const int connectivity, const struct Volume *srcVol,
+	const int fromSource)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType strideY = dstVol->strideY, strideZ = dstVol->strideZ;
+	SOURCE_LOCALS;
+
+	push(stack, k * strideZ + j * strideY + i);
+	while (!isEmpty(stack))
+	{
+		SizeType inx = pop(stack);
+		SizeType row, srcRow, iLeft, iRight;
+		int r;
+
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		row = inx - i;
+		srcRow = SOURCE_ROW(j, k);
+
+		/* Fill the run of the seed. */
+		for (iLeft = i; iLeft > box->iMin && UNLABELED(row + iLeft - 1, srcRow, iLeft - 1); iLeft--) {
+			dstData[row + iLeft - 1] = label;
+		}
+		for (iRight = i; iRight < box->iMax - 1 && UNLABELED(row + iRight + 1, srcRow, iRight + 1); iRight++) {
+			dstData[row + iRight + 1] = label;
+		}
+		if (acc != NULL) accumulateRun(acc, iLeft, iRight + 1, j, k);
+
+		for (r = 0; r < 8; r++) {
+			const int dj = neighborRows[r][0], dk = neighborRows[r][1];
+			const int widen = r < 4 || connectivity == 26;
+
+			if (j + dj < box->jMin || j + dj >= box->jMax || k + dk < box->kMin || k + dk >= box->kMax) continue;
+			seedRowSpans(dstData, row + dk * strideZ + dj * strideY, srcRow + SOURCE_ROW(dj, dk),
+				widen && iLeft > box->iMin ? iLeft - 1 : iLeft,
+				widen && iRight < box->iMax - 1 ? iRight + 1 : iRight, label, stack, srcData, fromSource);
+		}
+	}
+}
+
+void spanFillInBox18(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack,
+	struct ObjectAccumulator *acc, const struct Volume *srcVol)
+{
+	CALL_WITH_SOURCE(spanFillInBoxConnected, dstVol, box, i, j, k, label, stack, acc, 18);
+}
+
+void spanFillInBox26(struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, dstPixelType label, struct Stack *stack,
+	struct ObjectAccumulator *acc, const struct Volume *srcVol)
+{
+	CALL_WITH_SOURCE(spanFillInBoxConnected, dstVol, box, i, j, k, label, stack, acc, 26);
+}
+
+#undef CALL_WITH_SOURCE
+#undef UNLABELED
+#undef SOURCE_ROW
+#undef SOURCE_LOCALS
+
+/* The voxel-by-voxel and the span flood fill for connectivity. */
+FloodFillInBox dfsFloodFill(int connectivity)
+{
+	checkConnectivity(connectivity);
+	return connectivity == 6 ? singlePassDFSInBox : connectivity == 18 ? singlePassDFSInBox18 : singlePassDFSInBox26;
+}
+
+FloodFillInBox spanFloodFill(int connectivity)
+{
+	checkConnectivity(connectivity);
+	return connectivity == 6 ? spanFillInBox : connectivity == 18 ? spanFillInBox18 : spanFillInBox26;
+}
+
+/* Whether the labeling engines print the number of objects they found. The
+   benchmark turns this off, so that the trials time the labeling only, and
+   the library never turns it on. */
+#ifdef PARALLEL_LABELING_LIBRARY
+static int reportObjectCounts = 0;
+#else
+static int reportObjectCounts = 1;
+#endif
+
+/* Exit unless objectCount objects, labeled from 2, fit in dstPixelType, so
+   that labels never wrap around. runLengthLabelingPromote is the only engine
+   that picks a label width that fits instead; the others, and runBatch and
+   runTracking, which use the block engine, stop, as does the library with
+   LABELING_ERROR_LABELS. */
+void checkLabelCount(SizeType objectCount)
+{
+	if (objectCount + 1 > DST_PIXEL_MAX) {
+		printf("%td objects are too many for %d-bit labels, compile with a larger LABEL_BITS.\n", objectCount, LABEL_BITS);
+		exit(1);
+	}
+}
+
+/* The first voxel from i on of row (j, k), of dimX voxels, that may start an
+   object to label: an object voxel of srcVol, which may be bit-packed, or,
+   when srcVol is NULL, a voxel of dstVol that is 1; dimX when there is none.
+   Bit-packed rows skip whole words of background. */
+static inline SizeType nextSeedCandidate(const struct Volume *srcVol, const dstPixelType *dst, SizeType j, SizeType k, SizeType i, SizeType dimX)
+{
+	if (srcVol == NULL) {
+		while (i < dimX && dst[i] != 1) i++;
+	}
+	else if (srcVol->packing == VOLUME_PACKING_BITS) {
+		i = nextPackedVoxel((const uint64_t *)srcVol->data + k * srcVol->strideZ + j * srcVol->strideY, i, dimX, 1);
+	}
+	else {
+		const srcPixelType *src = (const srcPixelType *)srcVol->data + k * srcVol->strideZ + j * srcVol->strideY;
+		while (i < dimX && src[i] == 0) i++;
+	}
+	return i;
+}
+
+/* Label the objects that start in planes kMin up to kMax with labelStart,
+   labelStart + labelStep, and so on, flooding each object with floodFill:
+   singlePassDFSInBox or spanFillInBox. The object voxels are read from srcVol,
+   which may be bit-packed, into a zeroed dstVol, as set up by
+   prepareFloodSource, or, when srcVol is NULL, from dstVol holding a copy of
+   the image. Unless stats is NULL, the statistics of the objects, in the
+   order they are labeled, are gathered by the flood fill into stats, which
+   is allocated here; free it with freeObjectStats. */
+void singlePassLabeling(const struct Volume *srcVol, struct Volume *dstVol, const SizeType kMin, const SizeType kMax, const dstPixelType labelStart, const dstPixelType labelStep,
+	FloodFillInBox floodFill, struct ObjectStats *stats)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const struct Box wholeImage = { 0, dstVol->dimX, 0, dstVol->dimY, 0, dstVol->dimZ };
+	struct Stack *stack = getThreadStack();
+	struct ObjectAccumulator acc;
+
+	if (stack == NULL) checkLabelingResult(LABELING_ERROR_MEMORY);
+	if (stats != NULL) {
+		allocateObjectStats(stats, 0);
+	}
+
+	SizeType i, j, k;
+	SizeType label = labelStart;
+	SizeType objectCount = 0;
+	for (k = kMin; k < kMax; k++)
+	{
+		for (j = 0; j < dstVol->dimY; j++) {
+			dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			for (i = nextSeedCandidate(srcVol, dst, j, k, 0, dstVol->dimX); i < dstVol->dimX;
+				i = nextSeedCandidate(srcVol, dst, j, k, i + 1, dstVol->dimX)) {
+				if (srcVol == NULL || dst[i] == 0)
+				{
+					if (label > DST_PIXEL_MAX) {
+						printf("Too many objects for %d-bit labels, compile with a larger LABEL_BITS.\n", LABEL_BITS);
+						exit(1);
+					}
+					dst[i] = (dstPixelType)label;
+					if (stats != NULL) {
+						resetAccumulator(&acc);
+						floodFill(dstVol, &wholeImage, i, j, k, (dstPixelType)label, stack, &acc, srcVol);
+						appendObjectStats(stats, &acc);
+					}
+					else {
+						floodFill(dstVol, &wholeImage, i, j, k, (dstPixelType)label, stack, NULL, srcVol);
+					}
+					label += labelStep;
+					objectCount++;
+				}
+			}
+		}
+	}
+	if (stack->failed) checkLabelingResult(LABELING_ERROR_MEMORY);
+	if (reportObjectCounts) printf("Number of objects found in current subimage: %td\n", objectCount);
+}
+
+/* Label srcVol into dstVol. With a NULL srcVol, dstVol holds a copy of the
+   image and is labeled in place. */
+void singlePassLabelingDefault(const struct Volume *srcVol, struct Volume *dstVol, int connectivity, struct ObjectStats *stats)
+{
+	prepareFloodSource(srcVol, dstVol);
+	singlePassLabeling(srcVol, dstVol, 0, dstVol->dimZ, 2, 1, dfsFloodFill(connectivity), stats);
+}
+
+void singlePassLabelingSpan(const struct Volume *srcVol, struct Volume *dstVol, int connectivity, struct ObjectStats *stats)
+{
+	prepareFloodSource(srcVol, dstVol);
+	singlePassLabeling(srcVol, dstVol, 0, dstVol->dimZ, 2, 1, spanFloodFill(connectivity), stats);
+}
+
+/* Union-find on provisional labels. Roots are linked so that the smaller index
+   always becomes the root, which makes every root the smallest member of its
+   set. */
+SizeType ufFind(SizeType *parent, SizeType x)
+{
+	while (parent[x] != x) {
+		parent[x] = parent[parent[x]]; /* Path halving. */
+		x = parent[x];
+	}
+	return x;
+}
+
+void ufUnion(SizeType *parent, SizeType a, SizeType b)
+{
+	a = ufFind(parent, a);
+	b = ufFind(parent, b);
+	if (a < b) parent[b] = a;
+	else if (b < a) parent[a] = b;
+}
+
+/* Compute the box of block number blockNo in a grid of blocks of
+   blockDimX * blockDimY * blockDimZ voxels covering the whole volume. */
+void getBlockBox(const struct Volume *vol, SizeType blockNo, SizeType blockDimX, SizeType blockDimY, SizeType blockDimZ, struct Box *box)
+{
+	const SizeType nBlocksX = (vol->dimX + blockDimX - 1) / blockDimX;
+	const SizeType nBlocksY = (vol->dimY + blockDimY - 1) / blockDimY;
+	SizeType bi = blockNo % nBlocksX;
+	SizeType bj = (blockNo / nBlocksX) % nBlocksY;
+	SizeType bk = blockNo / (nBlocksX * nBlocksY);
+
+	box->iMin = bi * blockDimX;
+	box->iMax = box->iMin + blockDimX < vol->dimX ? box->iMin + blockDimX : vol->dimX;
+	box->jMin = bj * blockDimY;
+	box->jMax = box->jMin + blockDimY < vol->dimY ? box->jMin + blockDimY : vol->dimY;
+	box->kMin = bk * blockDimZ;
+	box->kMax = box->kMin + blockDimZ < vol->dimZ ? box->kMin + blockDimZ : vol->dimZ;
+}
+
+/* Record that the objects on both sides of a block face are the same whenever
+   two touching voxels are both object voxels. The face consists of the voxels
+   of face, each touching the voxel offset elements before it. Pairs are
+   pushed onto pairStack as (a, b); a pair equal to the previous one in the
+   same row is skipped. */
+void collectFacePairs(const struct Volume *dstVol, const struct Box *face, SizeType offset,
+	SizeType baseA, SizeType baseB, struct Stack *pairStack)
+{
+	const dstPixelType *dstData = (const dstPixelType *)dstVol->data;
+	SizeType i, j, k;
+	for (k = face->kMin; k < face->kMax; k++) {
+		for (j = face->jMin; j < face->jMax; j++) {
+			const dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			SizeType prevA = -1, prevB = -1;
+			for (i = face->iMin; i < face->iMax; i++) {
+				dstPixelType labelA = dst[i - offset];
+				dstPixelType labelB = dst[i];
+				if (labelA != 0 && labelB != 0) {
+					SizeType a = baseA + labelA - 2;
+					SizeType b = baseB + labelB - 2;
+					if (a != prevA || b != prevB) {
+						push(pairStack, a);
+						push(pairStack, b);
+						prevA = a;
+						prevB = b;
+					}
+				}
+			}
+		}
+	}
+}
+
+/* Record, for 18- or 26-connectivity, that the object of voxel (i, j, k) of
+   the block at box is the same as the objects it touches in other blocks.
+   Only neighbors earlier in memory order are visited, so every pair of
+   touching voxels is seen once. The label of the voxel is provisional label
+   base + label - 2; prevA and prevB hold the previous pair pushed. */
+void collectVoxelPairs(const struct Volume *dstVol, const struct Box *box, SizeType i, SizeType j, SizeType k, SizeType base,
+	SizeType blockDimX, SizeType blockDimY, SizeType blockDimZ, const SizeType *blockBase, int connectivity,
+	struct Stack *pairStack, SizeType *prevA, SizeType *prevB)
+{
+	const dstPixelType *dstData = (const dstPixelType *)dstVol->data;
+	const SizeType nBlocksX = (dstVol->dimX + blockDimX - 1) / blockDimX;
+	const SizeType nBlocksY = (dstVol->dimY + blockDimY - 1) / blockDimY;
+	const SizeType inx = k * dstVol->strideZ + j * dstVol->strideY + i;
+	const int maxOrder = neighborOrder(connectivity);
+	int di, dj, dk;
+
+	if (dstData[inx] == 0) return;
+	for (dk = -1; dk <= 0; dk++) {
+		for (dj = -1; dj <= 1; dj++) {
+			for (di = -1; di <= 1; di++) {
+				const SizeType ni = i + di, nj = j + dj, nk = k + dk;
+				const int order = (di != 0) + (dj != 0) + (dk != 0);
+				dstPixelType labelA;
+				SizeType a, b;
+
+				if (dk == 0 && (dj > 0 || (dj == 0 && di >= 0))) continue;
+				if (order > maxOrder || ni < 0 || ni >= dstVol->dimX || nj < 0 || nj >= dstVol->dimY || nk < 0) continue;
+				if (ni >= box->iMin && ni < box->iMax && nj >= box->jMin && nj < box->jMax && nk >= box->kMin) continue;
+				labelA = dstData[inx + dk * dstVol->strideZ + dj * dstVol->strideY + di];
+				if (labelA == 0) continue;
+				a = blockBase[ni / blockDimX + nBlocksX * (nj / blockDimY + nBlocksY * (nk / blockDimZ))] + labelA - 2;
+				b = base + dstData[inx] - 2;
+				if (a != *prevA || b != *prevB) {
+					push(pairStack, a);
+					push(pairStack, b);
+					*prevA = a;
+					*prevB = b;
+				}
+			}
+		}
+	}
+}
+
+/* collectVoxelPairs for every voxel of the block at box that may touch an
+   earlier block: the voxels of its lower Z face, its lower and upper Y faces,
+   and the first and last voxel of every other row. */
+void collectShellPairs(const struct Volume *dstVol, const struct Box *box, SizeType base,
+	SizeType blockDimX, SizeType blockDimY, SizeType blockDimZ, const SizeType *blockBase, int connectivity, struct Stack *pairStack)
+{
+	SizeType i, j, k;
+
+	for (k = box->kMin; k < box->kMax; k++) {
+		for (j = box->jMin; j < box->jMax; j++) {
+			SizeType prevA = -1, prevB = -1;
+
+			if (k == box->kMin || j == box->jMin || j == box->jMax - 1) {
+				for (i = box->iMin; i < box->iMax; i++) {
+					collectVoxelPairs(dstVol, box, i, j, k, base, blockDimX, blockDimY, blockDimZ, blockBase, connectivity,
+						pairStack, &prevA, &prevB);
+				}
+			}
+			else {
+				collectVoxelPairs(dstVol, box, box->iMin, j, k, base, blockDimX, blockDimY, blockDimZ, blockBase, connectivity,
+					pairStack, &prevA, &prevB);
+				if (box->iMax - 1 > box->iMin) {
+					collectVoxelPairs(dstVol, box, box->iMax - 1, j, k, base, blockDimX, blockDimY, blockDimZ, blockBase, connectivity,
+						pairStack, &prevA, &prevB);
+				}
+			}
+		}
+	}
+}
+
+/* Set the voxels of box in dstVol to those of srcVol, which may be bit-packed.
+   Unlike setDstToSource this runs on the calling thread alone, so that a
+   labeling engine can fill each block right before labeling it. */
+void setBoxToSource(const struct Volume *srcVol, struct Volume *dstVol, const struct Box *box)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	SizeType i, j, k;
+
+	for (k = box->kMin; k < box->kMax; k++) {
+		for (j = box->jMin; j < box->jMax; j++) {
+			dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+			if (srcVol->packing == VOLUME_PACKING_BITS) {
+				const uint64_t *words = (const uint64_t *)srcVol->data + k * srcVol->strideZ + j * srcVol->strideY;
+				for (i = box->iMin; i < box->iMax; i++) {
+					dst[i] = (dstPixelType)(words[i / 64] >> (i % 64) & 1);
+				}
+			}
+			else {
+				const srcPixelType *src = (const srcPixelType *)srcVol->data + k * srcVol->strideZ + j * srcVol->strideY;
+				for (i = box->iMin; i < box->iMax; i++) {
+					dst[i] = src[i];
+				}
+			}
+		}
+	}
+}
+
+/* Scratch tables of blockUnionFindLabelingWith: the label offsets of the
+   blocks, the union-find table with the global label of every provisional
+   label after it, and the per-thread object statistics. A labeling workspace
+   keeps them from call to call, so they are only reallocated when a call
+   needs more room than any call before. */
+struct BlockTables {
+	SizeType                 *blockBase, *equivalence;
+	struct ObjectAccumulator *threadAcc;
+	SizeType                  blockCapacity, equivalenceCapacity, threadAccCapacity;
+};
+
+/* Return table, which has room for *capacity elements of elemSize bytes, or,
+   when that is fewer than n, a new table with room for n of them, in which
+   case the old one is freed and its contents are lost. Return NULL, with
+   *capacity 0, when memory runs out. */
+void *reserveTable(void *table, SizeType *capacity, SizeType n, size_t elemSize)
+{
+	if (table == NULL || n > *capacity) {
+		free(table);
+		table = malloc((size_t)(n > 0 ? n : 1) * elemSize);
+		*capacity = table == NULL ? 0 : n;
+	}
+	return table;
+}
+
+void freeBlockTables(struct BlockTables *tables)
+{
+	free(tables->blockBase);
+	free(tables->equivalence);
+	free(tables->threadAcc);
+	memset(tables, 0, sizeof(*tables));
+}
+
+/* Label the image block by block. Every block of blockDimX * blockDimY *
+   blockDimZ voxels is labeled independently and in parallel with block-local
+   labels, the labels of objects touching across block faces are merged with a
+   union-find equivalence table, and finally every voxel gets its global label.
+   The resulting partition equals that of singlePassLabelingDefault; global
+   labels start at 2, but are numbered in block order rather than scan order.
+   The block-local labels of each block, 2 up to DST_PIXEL_MAX, must fit in
+   dstPixelType, which is guaranteed for blocks of at most
+   2 * (DST_PIXEL_MAX - 1) voxels, see fitBlockToLabels. With 18-
+   or 26-connectivity objects also touch across the edges and corners of
+   blocks, so the whole shell of each block is checked instead of its faces.
+   Each block of dstVol is filled from srcVol, which may be bit-packed, right
+   before it is labeled, while it is in cache, unless srcVol is NULL, in which
+   case dstVol holds a copy of the image already. Unless stats is NULL, the
+   statistics of the objects are gathered into stats, a table allocated
+   before or zeroed, which is emptied and grown as needed, while the global
+   labels are written. The scratch tables come from tables. Return the number
+   of objects, or one of the error codes of Parallel_Labeling.h, see
+   checkLabelingResult: LABELING_ERROR_LABELS when the objects do not fit in
+   dstPixelType, or LABELING_ERROR_MEMORY. */
+SizeType blockLabelingScheduled(const struct Volume *srcVol, struct Volume *dstVol, const SizeType blockDimX, const SizeType blockDimY,
+	const SizeType blockDimZ, int connectivity, struct ObjectStats *stats, struct BlockTables *tables)
+{
+	dstPixelType *dstData = (dstPixelType *)dstVol->data;
+	const SizeType nBlocksX = (dstVol->dimX + blockDimX - 1) / blockDimX;
+	const SizeType nBlocksY = (dstVol->dimY + blockDimY - 1) / blockDimY;
+	const SizeType nBlocksZ = (dstVol->dimZ + blockDimZ - 1) / blockDimZ;
+	const SizeType nBlocks = nBlocksX * nBlocksY * nBlocksZ;
+	const FloodFillInBox floodFill = dfsFloodFill(connectivity);
+	SizeType *blockBase, *parent, *labelMap;
+	SizeType blockNo, label, labelCount, objectCount;
+	SizeType result = 0;
+
+	blockBase = tables->blockBase = (SizeType *)reserveTable(tables->blockBase, &tables->blockCapacity, nBlocks + 1, sizeof(SizeType));
+	if (blockBase == NULL) return LABELING_ERROR_MEMORY;
+	dstVol->zeroed = 0;
+
+	/* Label every block on its own. Afterwards blockBase[b + 1] holds the
+	   number of objects found in block b. A thread without a work stack, or
+	   whose stack could not grow, labels no further blocks. */
+	blockBase[0] = 0;
+#pragma omp parallel
+	{
+		struct Stack *stack = getThreadStack();
+
+#pragma omp for schedule(runtime)
+		for (blockNo = 0; blockNo < nBlocks; blockNo++) {
+			struct Box box;
+			SizeType i, j, k;
+			SizeType localLabel = 2;
+
+			blockBase[blockNo + 1] = 0;
+			if (stack == NULL || stack->failed) continue;
+			getBlockBox(dstVol, blockNo, blockDimX, blockDimY, blockDimZ, &box);
+			if (srcVol != NULL) setBoxToSource(srcVol, dstVol, &box);
+			for (k = box.kMin; k < box.kMax; k++) {
+				for (j = box.jMin; j < box.jMax; j++) {
+					dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+					for (i = box.iMin; i < box.iMax; i++) {
+						if (dst[i] == 1 && localLabel <= DST_PIXEL_MAX)
+						{
+							dst[i] = (dstPixelType)localLabel;
+							floodFill(dstVol, &box, i, j, k, (dstPixelType)localLabel, stack, NULL, NULL);
+							localLabel++;
+						}
+						else if (dst[i] == 1) {
+#pragma omp atomic write
+							result = LABELING_ERROR_LABELS;
+						}
+					}
+				}
+			}
+			blockBase[blockNo + 1] = localLabel - 2;
+		}
+		if (stack == NULL || stack->failed) {
+#pragma omp atomic write
+			result = LABELING_ERROR_MEMORY;
+		}
+		if (stack != NULL) stack->failed = 0;
+	}
+	if (result != 0) return result;
+
+	/* Turn the per-block counts into offsets of each block in the table of
+	   provisional labels. */
+	for (blockNo = 0; blockNo < nBlocks; blockNo++) {
+		blockBase[blockNo + 1] += blockBase[blockNo];
+	}
+	labelCount = blockBase[nBlocks];
+
+	parent = tables->equivalence = (SizeType *)reserveTable(tables->equivalence, &tables->equivalenceCapacity, 2 * labelCount, sizeof(SizeType));
+	if (parent == NULL) return LABELING_ERROR_MEMORY;
+	labelMap = parent + labelCount;
+	for (label = 0; label < labelCount; label++) {
+		parent[label] = label;
+	}
+
+	/* Merge the labels of objects that touch across the lower X, Y and Z face
+	   of each block, or across its shell for 18- and 26-connectivity. Each thread gathers its pairs first, so the scan of the
+	   faces runs in parallel and only the unions are serialized. The pairs of
+	   a stack that could not grow are incomplete, and are dropped. */
+#pragma omp parallel
+	{
+		struct Stack *pairStack = getThreadPairStack();
+
+#pragma omp for schedule(runtime) nowait
+		for (blockNo = 0; blockNo < nBlocks; blockNo++) {
+			struct Box box, face;
+			SizeType bi = blockNo % nBlocksX;
+			SizeType bj = (blockNo / nBlocksX) % nBlocksY;
+			SizeType bk = blockNo / (nBlocksX * nBlocksY);
+
+			if (pairStack == NULL) continue;
+			getBlockBox(dstVol, blockNo, blockDimX, blockDimY, blockDimZ, &box);
+			if (connectivity != 6) {
+				collectShellPairs(dstVol, &box, blockBase[blockNo], blockDimX, blockDimY, blockDimZ, blockBase, connectivity, pairStack);
+				continue;
+			}
+			if (bi > 0) {
+				face = box;
+				face.iMax = face.iMin + 1;
+				collectFacePairs(dstVol, &face, 1,
+					blockBase[blockNo - 1], blockBase[blockNo], pairStack);
+			}
+			if (bj > 0) {
+				face = box;
+				face.jMax = face.jMin + 1;
+				collectFacePairs(dstVol, &face, dstVol->strideY,
+					blockBase[blockNo - nBlocksX], blockBase[blockNo], pairStack);
+			}
+			if (bk > 0) {
+				face = box;
+				face.kMax = face.kMin + 1;
+				collectFacePairs(dstVol, &face, dstVol->strideZ,
+					blockBase[blockNo - nBlocksX * nBlocksY], blockBase[blockNo], pairStack);
+			}
+		}
+
+		if (pairStack == NULL || pairStack->failed) {
+#pragma omp atomic write
+			result = LABELING_ERROR_MEMORY;
+		}
+		if (pairStack != NULL && pairStack->failed) {
+			pairStack->top = -1;
+			pairStack->size = 0;
+			pairStack->failed = 0;
+		}
+#pragma omp critical
+		{
+			while (pairStack != NULL && !isEmpty(pairStack)) {
+				SizeType b = pop(pairStack);
+				SizeType a = pop(pairStack);
+				ufUnion(parent, a, b);
+			}
+		}
+	}
+	if (result != 0) return result;
+
+	/* Number the equivalence classes. Since a root is the smallest member of
+	   its class, it has been numbered before any other member is reached. */
+	objectCount = 0;
+	for (label = 0; label < labelCount; label++) {
+		if (parent[label] == label) {
+			labelMap[label] = 2 + objectCount;
+			objectCount++;
+		}
+		else {
+			labelMap[label] = labelMap[ufFind(parent, label)];
+		}
+	}
+	if (reportObjectCounts) printf("Number of objects found: %td\n", objectCount);
+	if (objectCount + 1 > DST_PIXEL_MAX) return LABELING_ERROR_LABELS;
+
+	/* Replace the block-local labels by the global ones. */
+	if (stats == NULL) {
+#pragma omp parallel for schedule(runtime)
+		for (blockNo = 0; blockNo < nBlocks; blockNo++) {
+			struct Box box;
+			SizeType i, j, k;
+
+			getBlockBox(dstVol, blockNo, blockDimX, blockDimY, blockDimZ, &box);
+			for (k = box.kMin; k < box.kMax; k++) {
+				for (j = box.jMin; j < box.jMax; j++) {
+					dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+					for (i = box.iMin; i < box.iMax; i++) {
+						if (dst[i] != 0) {
+							dst[i] = (dstPixelType)labelMap[blockBase[blockNo] + dst[i] - 2];
+						}
+					}
+				}
+			}
+		}
+	}
+	else {
+		/* Add every run of equal block-local labels along X to an
+		   accumulator: that of its object in the table of the thread, or,
+		   when those tables would not fit, see threadAccumulatorsFit, that
+		   of its provisional label. A provisional label belongs to one block,
+		   and so to one thread, and its accumulator is merged into that of
+		   its root afterwards; these take labelCount accumulators. */
+		const int nThreads = omp_get_max_threads();
+		const int perThread = threadAccumulatorsFit(nThreads, objectCount, dstVol->dimX * dstVol->dimY * dstVol->dimZ);
+		struct ObjectAccumulator *threadAcc = tables->threadAcc = (struct ObjectAccumulator *)reserveTable(tables->threadAcc,
+			&tables->threadAccCapacity, perThread ? (SizeType)nThreads * objectCount : labelCount, sizeof(struct ObjectAccumulator));
+
+		if (threadAcc == NULL || !reserveObjectStats(stats, objectCount)) return LABELING_ERROR_MEMORY;
+		resetThreadAccumulators(threadAcc, perThread ? nThreads : 1, perThread ? objectCount : labelCount);
+
+#pragma omp parallel
+		{
+			struct ObjectAccumulator *acc = threadAcc + (perThread ? (SizeType)omp_get_thread_num() * objectCount : 0);
+
+#pragma omp for schedule(runtime)
+			for (blockNo = 0; blockNo < nBlocks; blockNo++) {
+				const SizeType base = blockBase[blockNo];
+				struct Box box;
+				SizeType i, j, k;
+
+				getBlockBox(dstVol, blockNo, blockDimX, blockDimY, blockDimZ, &box);
+				for (k = box.kMin; k < box.kMax; k++) {
+					for (j = box.jMin; j < box.jMax; j++) {
+						dstPixelType *dst = dstData + k * dstVol->strideZ + j * dstVol->strideY;
+						SizeType runLabel = 0, runStart = box.iMin;
+						for (i = box.iMin; i < box.iMax; i++) {
+							const SizeType local = dst[i];
+							if (local != runLabel) {
+								if (runLabel != 0) {
+									accumulateRun(acc + (perThread ? labelMap[base + runLabel - 2] - 2 : base + runLabel - 2), runStart, i, j, k);
+								}
+								runLabel = local;
+								runStart = i;
+							}
+							if (local != 0) dst[i] = (dstPixelType)labelMap[base + local - 2];
+						}
+						if (runLabel != 0) {
+							accumulateRun(acc + (perThread ? labelMap[base + runLabel - 2] - 2 : base + runLabel - 2), runStart, box.iMax, j, k);
+						}
+					}
+				}
+			}
+		}
+		if (perThread) {
+			mergeThreadAccumulatorsInto(threadAcc, nThreads, objectCount, stats);
+		}
+		else {
+			/* A root is the smallest label of its class, so each label is
+			   merged into a root that is complete apart from later labels. */
+			for (label = 0; label < labelCount; label++) {
+				const SizeType root = ufFind(parent, label);
+				if (root != label) mergeAccumulator(&threadAcc[root], &threadAcc[label]);
+			}
+			for (label = 0; label < labelCount; label++) {
+				if (parent[label] == label) setObjectStats(stats, labelMap[label] - 2, &threadAcc[label]);
+			}
+			stats->objectCount = objectCount;
+		}
+	}
+	return objectCount;
+}
+
+/* blockLabelingScheduled with the schedule of its loops over blocks set for
+   the call, so that the caller's is restored however it returns. */
+SizeType blockUnionFindLabelingWith(const struct Volume *srcVol, struct Volume *dstVol, const SizeType blockDimX, const SizeType blockDimY,
+	const SizeType blockDimZ, int connectivity, struct ObjectStats *stats, struct BlockTables *tables)
+{
+	const int nThreads = omp_get_max_threads();
+	const SizeType blocksPerSlab = ((dstVol->dimX + blockDimX - 1) / blockDimX) * ((dstVol->dimY + blockDimY - 1) / blockDimY);
+	const SizeType nBlocks = blocksPerSlab * ((dstVol->dimZ + blockDimZ - 1) / blockDimZ);
+	omp_sched_t callerSchedule;
+	int callerChunk;
+	SizeType result;
+
+	/* The loops over blocks hand out blocks dynamically, except when there
+	   are no more blocks than threads, as for parallelEdgeFirstSinglePassLabeling.
+	   Then block b goes to thread b, which with numaFirstTouch placed its
+	   memory. With numaFirstTouch the same holds for blocks one slab of
+	   firstTouchVolume deep, as parallelSlabLabeling makes when it splits
+	   its slabs into rows: the blocks of slab t, which are consecutive, all
+	   go to thread t. */
+	omp_get_schedule(&callerSchedule, &callerChunk);
+	if (nBlocks <= nThreads) {
+		omp_set_schedule(omp_sched_static, 1);
+	}
+	else if (numaFirstTouch && blockDimZ == (dstVol->dimZ + nThreads - 1) / nThreads && blocksPerSlab <= INT_MAX) {
+		omp_set_schedule(omp_sched_static, (int)blocksPerSlab);
+	}
+	else {
+		omp_set_schedule(omp_sched_dynamic, 1);
+	}
+	result = blockLabelingScheduled(srcVol, dstVol, blockDimX, blockDimY, blockDimZ, connectivity, stats, tables);
+	omp_set_schedule(callerSchedule, callerChunk);
+	return result;
+}
+
+/* blockUnionFindLabelingWith with tables of its own, which are freed
+   afterwards; stats, unless NULL, is allocated here. */
+void blockUnionFindLabeling(const struct Volume *srcVol, struct Volume *dstVol, const SizeType blockDimX, const SizeType blockDimY, const SizeType blockDimZ,
+	int connectivity, struct ObjectStats *stats)
+{
+	struct BlockTables tables;
+
+	memset(&tables, 0, sizeof(tables));
+	if (stats != NULL) memset(stats, 0, sizeof(*stats));
+	checkLabelingResult(blockUnionFindLabelingWith(srcVol, dstVol, blockDimX, blockDimY, blockDimZ, connectivity, stats, &tables));
+	freeBlockTables(&tables);
+}
+
+void blockUnionFindLabelingDefault(const struct Volume *srcVol, struct Volume *dstVol, int connectivity, struct ObjectStats *stats)
+{
+	blockUnionFindLabeling(srcVol, dstVol, BLOCK_DIM_X, BLOCK_DIM_Y, BLOCK_DIM_Z, connectivity, stats);
+}
+
+/* Shrink a block of *blockDimX * *blockDimY * *blockDimZ voxels until it
+   holds at most 2 * (DST_PIXEL_MAX - 1) voxels, and so at most DST_PIXEL_MAX
+   - 1 objects, whose block-local labels then fit in dstPixelType. The block
+   keeps its depth and whole rows as long as it can: Y is cut first, then X,
+   and Z only when a single voxel column is too long. */
+void fitBlockToLabels(SizeType *blockDimX, SizeType *blockDimY, SizeType *blockDimZ)
+{
+	const SizeType maxVoxels = DST_PIXEL_MAX - 1 > PTRDIFF_MAX / 2 ? PTRDIFF_MAX : 2 * (DST_PIXEL_MAX - 1);
+
+	if (*blockDimZ > maxVoxels) *blockDimZ = maxVoxels;
+	if (*blockDimX > maxVoxels / *blockDimZ) *blockDimX = maxVoxels / *blockDimZ;
+	if (*blockDimY > maxVoxels / (*blockDimX * *blockDimZ)) *blockDimY = maxVoxels / (*blockDimX * *blockDimZ);
+}
+
+/* Label the image in nSlabs slabs of whole Z-planes. Each slab is labeled by
+   exactly one thread, without flooding into its neighbors, and the objects
+   crossing the slab boundaries are unified afterwards, so no part of the
+   labeling runs serially over the image. Slabs with more voxels than
+   block-local labels can cover, see fitBlockToLabels, are split into blocks
+   of fewer rows, which the threads share dynamically, unless numaFirstTouch
+   placed the slabs: then each thread keeps the blocks of its own slab, see
+   blockUnionFindLabelingWith. */
+void parallelSlabLabeling(const struct Volume *srcVol, struct Volume *dstVol, SizeType nSlabs, int connectivity, struct ObjectStats *stats)
+{
+	SizeType blockDimX = dstVol->dimX > 0 ? dstVol->dimX : 1, blockDimY = dstVol->dimY > 0 ? dstVol->dimY : 1, blockDimZ;
+
+	if (nSlabs > dstVol->dimZ) nSlabs = dstVol->dimZ;
+	if (nSlabs < 1) nSlabs = 1;
+	blockDimZ = (dstVol->dimZ + nSlabs - 1) / nSlabs;
+	if (blockDimZ < 1) blockDimZ = 1;
+	fitBlockToLabels(&blockDimX, &blockDimY, &blockDimZ);
+	blockUnionFindLabeling(srcVol, dstVol, blockDimX, blockDimY, blockDimZ, connectivity, stats);
+}
+
+/* Label the image in as many slabs as there are threads. */
+void parallelEdgeFirstSinglePassLabeling(const struct Volume *srcVol, struct Volume *dstVol, int connectivity, struct ObjectStats *stats)
+{
+	parallelSlabLabeling(srcVol, dstVol, omp_get_max_threads(), connectivity, stats);
+}
+
+/* Append label to *list, which holds *count labels in room for *capacity,
+   growing it when it is full. Return 0 when memory runs out, and 1
+   otherwise. */
+int appendLabel(SizeType **list, SizeType *count, SizeType *capacity, SizeType label)
+{
+	if (*list == NULL || *count == *capacity) {
+		const SizeType grown = 2 * *capacity + 64;
+		SizeType *p = (SizeType *)realloc(*list, (size_t)grown * sizeof(SizeType));
+		if (p == NULL) return 0;
+		*list = p;
+		*capacity = grown;
+	}
+	(*list)[(*count)++] = label;
+	return 1;
+}
+
+void freeLabelChanges(struct LabelChanges *changes)
+{
+	free(changes->removed);
+	free(changes->added);
+	memset(changes, 0, sizeof(*changes));
+}
+
+/* Clear the object labeled label that holds voxel seed of labelVol, found by
+   following its old labels, which also cross voxels that are background in
+   srcData now. Each of its voxels becomes 1, to be labeled again, when it is
+   an object voxel of srcData, and is pushed onto pending, or 0 otherwise.
+   stack is the work stack. */
+void clearObject(const srcPixelType *srcData, struct Volume *labelVol, SizeType seed, dstPixelType label, int connectivity,
+	struct Stack *pending, struct Stack *stack)
+{
+	dstPixelType *labels = (dstPixelType *)labelVol->data;
+	const SizeType strideY = labelVol->strideY, strideZ = labelVol->strideZ;
+	const int maxOrder = neighborOrder(connectivity);
+
+	labels[seed] = (dstPixelType)(srcData[seed] != 0);
+	if (labels[seed] == 1) push(pending, seed);
+	push(stack, seed);
+	while (!isEmpty(stack))
+	{
+		SizeType inx = pop(stack);
+		SizeType i, j, k;
+		int di, dj, dk;
+
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		for (dk = -1; dk <= 1; dk++) {
+			if (k + dk < 0 || k + dk >= labelVol->dimZ) continue;
+			for (dj = -1; dj <= 1; dj++) {
+				if (j + dj < 0 || j + dj >= labelVol->dimY) continue;
+				for (di = -1; di <= 1; di++) {
+					const int order = (di != 0) + (dj != 0) + (dk != 0);
+					SizeType n;
+
+					if (order == 0 || order > maxOrder || i + di < 0 || i + di >= labelVol->dimX) continue;
+					n = inx + dk * strideZ + dj * strideY + di;
+					if (labels[n] == label) {
+						labels[n] = (dstPixelType)(srcData[n] != 0);
+						if (labels[n] == 1) push(pending, n);
+						push(stack, n);
+					}
+				}
+			}
+		}
+	}
+}
+
+/* Update labelVol, the labels of srcVol before the changedCount voxels at the
+   indices changed, counted as in labelVol, were toggled, to the labels of
+   srcVol as it is now. Every object that held a changed voxel or touches one
+   that became an object voxel is cleared with clearObject, its label being
+   added to the removed labels of changes, and the voxels thus cleared are
+   flooded again, each new object getting the next removed label that is not
+   reused yet, or else *nextLabel, which is then incremented. Objects that do
+   not touch the changed voxels keep their labels, and the cost only depends
+   on the objects touched. Any partition of labels from 2 up will do, as
+   given by the labeling engines with *nextLabel one more than the largest
+   label. changes is a table allocated before or zeroed, which is emptied and
+   grown as needed; free it with freeLabelChanges. Return the number of
+   objects labeled, or one of the error codes of Parallel_Labeling.h, see
+   checkLabelingResult. Changed voxels outside the image, or an image not
+   laid out like labelVol, are rejected before any label changes. */
+SizeType relabelEdits(const struct Volume *srcVol, struct Volume *labelVol, const SizeType *changed, SizeType changedCount,
+	int connectivity, SizeType *nextLabel, struct LabelChanges *changes)
+{
+	const srcPixelType *srcData = (const srcPixelType *)srcVol->data;
+	dstPixelType *labels = (dstPixelType *)labelVol->data;
+	const SizeType strideY = labelVol->strideY, strideZ = labelVol->strideZ;
+	const SizeType voxelCount = strideZ * labelVol->dimZ;
+	const struct Box wholeImage = { 0, labelVol->dimX, 0, labelVol->dimY, 0, labelVol->dimZ };
+	const FloodFillInBox floodFill = dfsFloodFill(connectivity);
+	const int maxOrder = neighborOrder(connectivity);
+	struct Stack *pending = getThreadPairStack();
+	struct Stack *stack = getThreadStack();
+	SizeType c, reused = 0;
+	int appended = 1;
+
+	if (srcVol->packing == VOLUME_PACKING_BITS || srcVol->strideY != strideY || srcVol->strideZ != strideZ) {
+		return LABELING_ERROR_ARGUMENT;
+	}
+	for (c = 0; c < changedCount; c++) {
+		const SizeType inx = changed[c];
+		if (inx < 0 || inx >= voxelCount || inx % strideZ % strideY >= labelVol->dimX || inx % strideZ / strideY >= labelVol->dimY) {
+			return LABELING_ERROR_ARGUMENT;
+		}
+	}
+	if (pending == NULL || stack == NULL) return LABELING_ERROR_MEMORY;
+	changes->removedCount = 0;
+	changes->addedCount = 0;
+	labelVol->zeroed = 0;
+
+	/* Clear the objects touched by the changes. Once cleared, an object no
+	   longer holds its label, so every object is cleared only once. */
+	for (c = 0; c < changedCount; c++) {
+		const SizeType inx = changed[c];
+		SizeType i, j, k;
+		int di, dj, dk;
+
+		if (labels[inx] > 1) {
+			appended &= appendLabel(&changes->removed, &changes->removedCount, &changes->removedCapacity, labels[inx]);
+			clearObject(srcData, labelVol, inx, labels[inx], connectivity, pending, stack);
+		}
+		if (srcData[inx] == 0) continue;
+		if (labels[inx] == 0) {
+			labels[inx] = 1;
+			push(pending, inx);
+		}
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		for (dk = -1; dk <= 1; dk++) {
+			if (k + dk < 0 || k + dk >= labelVol->dimZ) continue;
+			for (dj = -1; dj <= 1; dj++) {
+				if (j + dj < 0 || j + dj >= labelVol->dimY) continue;
+				for (di = -1; di <= 1; di++) {
+					const int order = (di != 0) + (dj != 0) + (dk != 0);
+					SizeType n;
+
+					if (order == 0 || order > maxOrder || i + di < 0 || i + di >= labelVol->dimX) continue;
+					n = inx + dk * strideZ + dj * strideY + di;
+					if (labels[n] > 1) {
+						appended &= appendLabel(&changes->removed, &changes->removedCount, &changes->removedCapacity, labels[n]);
+						clearObject(srcData, labelVol, n, labels[n], connectivity, pending, stack);
+					}
+				}
+			}
+		}
+	}
+
+	/* Label the cleared object voxels again. They only touch each other, as
+	   objects touching a cleared one were one object with it before, or touch
+	   a changed voxel, and are cleared as well. */
+	while (!isEmpty(pending)) {
+		const SizeType inx = pop(pending);
+		SizeType label, i, j, k;
+
+		if (labels[inx] != 1) continue;
+		if (reused < changes->removedCount) {
+			label = changes->removed[reused++];
+		}
+		else {
+			if (*nextLabel > DST_PIXEL_MAX) {
+				pending->top = -1;
+				pending->size = 0;
+				return LABELING_ERROR_LABELS;
+			}
+			label = (*nextLabel)++;
+		}
+		appended &= appendLabel(&changes->added, &changes->addedCount, &changes->addedCapacity, label);
+		k = inx / strideZ;
+		j = (inx - k * strideZ) / strideY;
+		i = inx - k * strideZ - j * strideY;
+		labels[inx] = (dstPixelType)label;
+		floodFill(labelVol, &wholeImage, i, j, k, (dstPixelType)label, stack, NULL, NULL);
+	}
+	if (!appended || pending->failed || stack->failed) {
+		pending->failed = 0;
+		stack->failed = 0;
+		return LABELING_ERROR_MEMORY;
+	}
+	return changes->addedCount;
+}
+
+/* Replace each entry of a union-find table of n provisional labels by the
+   global label of its class. Classes are numbered from 2 in the order of their
+   roots, which are the smallest members of their class. While resolving, the
+   entries below x already hold their global label, negated, so every parent
+   can be looked up directly. Return the number of classes. */
+SizeType resolveLabels(SizeType *parent, SizeType n)
+{
+	SizeType x, classCount = 0;
+
+	for (x = 0; x < n; x++) {
+		if (parent[x] == x) {
+			parent[x] = -(2 + classCount);
+			classCount++;
+		}
+		else {
+			parent[x] = parent[parent[x]];
+		}
+	}
+	for (x = 0; x < n; x++) {
+		parent[x] = -parent[x];
+	}
+	return classCount;
+}
+
+/* Size in bytes of the narrowest labels, of 16 bits or more, that hold
+   objectCount objects numbered from 2. */
+size_t labelSizeFor(SizeType objectCount)
+{
+	if (objectCount + 1 <= (SizeType)UINT16_MAX) return sizeof(uint16_t);
+	if (objectCount + 1 <= (SizeType)UINT32_MAX) return sizeof(uint32_t);
+	return sizeof(uint64_t);
+}
+
+/* Label the Z-plane in plane, writing provisional labels (1 + an index in
+   the equivalence table, 0 for background) into labels. Within a plane
+   6-connectivity reduces to 4-connectivity, and 18- and 26-connectivity to
+   8-connectivity. The components of the plane are resolved before they enter
+   the table, so the table grows by the number of 2-D components of the plane
+   only. localParent must hold dimX * dimY / 2 + dimY + 2 entries. */
+void labelPlaneProvisional(const srcPixelType *plane, uint32_t *labels, SizeType dimX, SizeType dimY, int connectivity,
+	SizeType *localParent, SizeType **parentPtr, SizeType *labelCount, SizeType *capacity)
+{
+	SizeType i, j, x, localCount = 0;
+
+	/* Raster scan with union-find on plane-local labels. */
+	if (connectivity == 6) {
+		for (j = 0; j < dimY; j++) {
+			for (i = 0; i < dimX; i++) {
+				SizeType inx = j * dimX + i;
+				uint32_t left, up;
+
+				if (plane[inx] == 0) {
+					labels[inx] = 0;
+					continue;
+				}
+				left = i >= 1 ? labels[inx - 1] : 0;
+				up = j >= 1 ? labels[inx - dimX] : 0;
+				if (left == 0 && up == 0) {
+					localParent[localCount] = localCount;
+					localCount++;
+					labels[inx] = (uint32_t)localCount;
+				}
+				else if (left != 0 && up != 0) {
+					labels[inx] = left;
+					ufUnion(localParent, left - 1, up - 1);
+				}
+				else {
+					labels[inx] = left | up;
+				}
+			}
+		}
+	}
+	else {
+		for (j = 0; j < dimY; j++) {
+			for (i = 0; i < dimX; i++) {
+				SizeType inx = j * dimX + i;
+				uint32_t earlier[4], label = 0;
+				int n;
+
+				if (plane[inx] == 0) {
+					labels[inx] = 0;
+					continue;
+				}
+				earlier[0] = i >= 1 ? labels[inx - 1] : 0;
+				earlier[1] = i >= 1 && j >= 1 ? labels[inx - dimX - 1] : 0;
+				earlier[2] = j >= 1 ? labels[inx - dimX] : 0;
+				earlier[3] = i < dimX - 1 && j >= 1 ? labels[inx - dimX + 1] : 0;
+				for (n = 0; n < 4; n++) {
+					if (earlier[n] == 0) continue;
+					if (label == 0) label = earlier[n];
+					else if (earlier[n] != label) ufUnion(localParent, label - 1, earlier[n] - 1);
+				}
+				if (label == 0) {
+					localParent[localCount] = localCount;
+					localCount++;
+					label = (uint32_t)localCount;
+				}
+				labels[inx] = label;
+			}
+		}
+	}
+
+	/* Give each 2-D component an entry in the global table, and let every
+	   local label map to the entry of its component. Parents precede their
+	   children, so a child finds its entry, negated, at its parent. */
+	for (x = 0; x < localCount; x++) {
+		if (localParent[x] == x) {
+			if (*labelCount == *capacity) {
+				SizeType *grown;
+				*capacity *= 2;
+				grown = (SizeType *)realloc(*parentPtr, (size_t)*capacity * sizeof(SizeType));
+				if (grown == NULL) {
+					printf("Failed to grow the equivalence table to %td labels. \n", *capacity);
+					exit(1);
+				}
+				*parentPtr = grown;
+			}
+			if (*labelCount >= (SizeType)UINT32_MAX) {
+				printf("Too many provisional labels for streaming labeling. \n");
+				exit(1);
+			}
+			(*parentPtr)[*labelCount] = *labelCount;
+			localParent[x] = -1 - *labelCount;
+			(*labelCount)++;
+		}
+		else {
+			localParent[x] = localParent[localParent[x]];
+		}
+	}
+	for (x = 0; x < dimX * dimY; x++) {
+		if (labels[x] != 0) labels[x] = (uint32_t)(-localParent[labels[x] - 1]);
+	}
+}
+
+/* Merge the provisional labels of a plane with those of the previous plane
+   for 18- or 26-connectivity: besides the voxel right behind it, a voxel
+   touches the four voxels sharing an edge with it in the previous plane, and
+   with 26-connectivity the four sharing a corner too. */
+void mergeWithPreviousPlane(const uint32_t *labels, const uint32_t *prevLabels, SizeType dimX, SizeType dimY, int connectivity,
+	SizeType *parent)
+{
+	const int maxOrder = neighborOrder(connectivity);
+	SizeType i, j;
+	int di, dj;
+
+	for (j = 0; j < dimY; j++) {
+		for (i = 0; i < dimX; i++) {
+			const uint32_t label = labels[j * dimX + i];
+			if (label == 0) continue;
+			for (dj = -1; dj <= 1; dj++) {
+				if (j + dj < 0 || j + dj >= dimY) continue;
+				for (di = -1; di <= 1; di++) {
+					uint32_t prevLabel;
+					if (1 + (di != 0) + (dj != 0) > maxOrder || i + di < 0 || i + di >= dimX) continue;
+					prevLabel = prevLabels[(j + dj) * dimX + i + di];
+					if (prevLabel != 0) ufUnion(parent, prevLabel - 1, label - 1);
+				}
+			}
+		}
+	}
+}
+
+/* Label a volume file or ascii image of any depth with 6-, 18- or
+   26-connectivity while holding only two planes in memory. Each plane is
+   labeled against the previous one, equivalences go into a compact union-find
+   table, and the provisional labels are written to a temporary file. A final
+   pass resolves them to global labels, numbered from 2, and writes them to
+   outName if it is not NULL, as 16-bit labels unless more bits are needed.
+   Peak memory is a few planes plus the equivalence table, whatever the depth.
+   Return the number of objects. */
+SizeType streamLabeling(const char *inName, SizeType dimX, SizeType dimY, SizeType dimZ, const char *outName, int connectivity)
+{
+	struct PlaneReader reader;
+	srcPixelType *plane;
+	uint32_t *labels, *prevLabels, *swap;
+	void *outPlane;
+	SizeType *parent, *localParent;
+	SizeType capacity, labelCount = 0, objectCount, planeSize, x, k;
+	FILE *tmpFp, *outFp = NULL;
+
+	checkConnectivity(connectivity);
+	openPlaneReader(&reader, inName, dimX, dimY, dimZ);
+	dimX = reader.dimX;
+	dimY = reader.dimY;
+	dimZ = reader.dimZ;
+	planeSize = dimX * dimY;
+
+	plane = (srcPixelType *)malloc((size_t)planeSize * sizeof(srcPixelType));
+	labels = (uint32_t *)malloc((size_t)planeSize * sizeof(uint32_t));
+	prevLabels = (uint32_t *)malloc((size_t)planeSize * sizeof(uint32_t));
+	localParent = (SizeType *)malloc((size_t)(planeSize / 2 + dimY + 2) * sizeof(SizeType));
+	capacity = planeSize / 2 + dimY + 2;
+	parent = (SizeType *)malloc((size_t)capacity * sizeof(SizeType));
+	if (plane == NULL || labels == NULL || prevLabels == NULL || localParent == NULL || parent == NULL) {
+		printf("Failed to allocate the plane buffers for streaming labeling. \n");
+		exit(1);
+	}
+	tmpFp = tmpfile();
+	if (tmpFp == NULL) {
+		printf("Failed to create a temporary file for the provisional labels. \n");
+		exit(1);
+	}
+
+	/* First pass: label plane by plane and merge with the previous plane. */
+	for (k = 0; k < dimZ; k++) {
+		SizeType prevA = -1, prevB = -1;
+
+		readPlane(&reader, plane);
+		labelPlaneProvisional(plane, labels, dimX, dimY, connectivity, localParent, &parent, &labelCount, &capacity);
+		if (k >= 1 && connectivity != 6) {
+			mergeWithPreviousPlane(labels, prevLabels, dimX, dimY, connectivity, parent);
+		}
+		else if (k >= 1) {
+			for (x = 0; x < planeSize; x++) {
+				if (labels[x] != 0 && prevLabels[x] != 0 &&
+					((SizeType)prevLabels[x] != prevA || (SizeType)labels[x] != prevB)) {
+					prevA = prevLabels[x];
+					prevB = labels[x];
+					ufUnion(parent, prevA - 1, prevB - 1);
+				}
+			}
+		}
+		if (fwrite(labels, sizeof(uint32_t), (size_t)planeSize, tmpFp) != (size_t)planeSize) {
+			printf("Failed to write provisional labels to the temporary file. \n");
+			exit(1);
+		}
+		swap = prevLabels;
+		prevLabels = labels;
+		labels = swap;
+	}
+	closePlaneReader(&reader);
+
+	objectCount = resolveLabels(parent, labelCount);
+	if (reportObjectCounts) printf("Number of objects found: %td\n", objectCount);
+
+	/* Second pass: replace the provisional labels by the global ones, written
+	   with 16 bits unless there are too many objects for them. */
+	if (outName != NULL) {
+		const size_t labelSize = labelSizeFor(objectCount);
+		outPlane = malloc((size_t)planeSize * labelSize);
+		outFp = fopen(outName, "wb");
+		if (outPlane == NULL || outFp == NULL) {
+			printf("Failed to open %s for writing. \n", outName);
+			exit(1);
+		}
+		writeVolumeHeader(outFp, outName, dimX, dimY, dimZ, labelSize, VOLUME_PACKING_NONE);
+		rewind(tmpFp);
+		for (k = 0; k < dimZ; k++) {
+			if (fread(labels, sizeof(uint32_t), (size_t)planeSize, tmpFp) != (size_t)planeSize) {
+				printf("Failed to read provisional labels from the temporary file. \n");
+				exit(1);
+			}
+			if (labelSize == sizeof(uint16_t)) {
+				uint16_t *out = (uint16_t *)outPlane;
+#pragma omp parallel for
+				for (x = 0; x < planeSize; x++) {
+					out[x] = labels[x] == 0 ? 0 : (uint16_t)parent[labels[x] - 1];
+				}
+			}
+			else if (labelSize == sizeof(uint32_t)) {
+				uint32_t *out = (uint32_t *)outPlane;
+#pragma omp parallel for
+				for (x = 0; x < planeSize; x++) {
+					out[x] = labels[x] == 0 ? 0 : (uint32_t)parent[labels[x] - 1];
+				}
+			}
+			else {
+				uint64_t *out = (uint64_t *)outPlane;
+#pragma omp parallel for
+				for (x = 0; x < planeSize; x++) {
+					out[x] = labels[x] == 0 ? 0 : (uint64_t)parent[labels[x] - 1];
+				}
+			}
+			if (fwrite(outPlane, labelSize, (size_t)planeSize, outFp) != (size_t)planeSize) {
+				printf("Failed to write to %s.\n", outName);
+				exit(1);
+			}
+		}
+		fclose(outFp);
+		free(outPlane);
+	}
+
+	fclose(tmpFp);
+	free(parent);
+	free(localParent);
+	free(prevLabels);
+	free(labels);
+	free(plane);
+	return objectCount;
+}
+
+/* A maximal run of object voxels along X: voxels iStart up to, but not
+   including, iEnd of one row. */
+struct Run {
+	SizeType iStart, iEnd;
+};
+
+/* The runs of object voxels of all rows of a volume. The runs of row
+   k * dimY + j are runs rowStart[row] up to rowStart[row + 1], in increasing
+   order. parent is a union-find equivalence table over the runs; once the
+   runs are labeled it holds the label of the object of each run instead. */
+struct RunTable {
+	SizeType   *rowStart;
+	struct Run *runs;
+	SizeType   *parent;
+	SizeType    runCount;
+};
+
+/* Count the runs of object voxels in a row of n elements of elemSize bytes,
+   or store them in runs if it is not NULL. The scan is spelled out per
+   element width, so that its inner loops stay simple. */
+SizeType findRowRuns(const void *row, size_t elemSize, SizeType n, struct Run *runs)
+{
+	SizeType i = 0, runCount = 0;
+
+#define FIND_ROW_RUNS(type) \
+	{ \
+		const type *p = (const type *)row; \
+		while (i < n) { \
+			while (i < n && p[i] == 0) i++; \
+			if (i == n) break; \
+			if (runs != NULL) runs[runCount].iStart = i; \
+			while (i < n && p[i] != 0) i++; \
+			if (runs != NULL) runs[runCount].iEnd = i; \
+			runCount++; \
+		} \
+	}
+	switch (elemSize) {
+	case 1: FIND_ROW_RUNS(uint8_t); break;
+	case 2: FIND_ROW_RUNS(uint16_t); break;
+	case 4: FIND_ROW_RUNS(uint32_t); break;
+	default: FIND_ROW_RUNS(uint64_t); break;
+	}
+#undef FIND_ROW_RUNS
+	return runCount;
+}
+
+/* findRowRuns for a bit-packed row of n voxels. */
+SizeType findPackedRowRuns(const uint64_t *words, SizeType n, struct Run *runs)
+{
+	SizeType i = 0, runCount = 0;
+
+	while ((i = nextPackedVoxel(words, i, n, 1)) < n) {
+		if (runs != NULL) runs[runCount].iStart = i;
+		i = nextPackedVoxel(words, i, n, 0);
+		if (runs != NULL) runs[runCount].iEnd = i;
+		runCount++;
+	}
+	return runCount;
+}
+
+/* Find the runs of row row of vol, which may be bit-packed, counting the
+   rows of all planes in order. */
+SizeType findVolumeRowRuns(const struct Volume *vol, SizeType row, struct Run *runs)
+{
+	const SizeType offset = (row / vol->dimY) * vol->strideZ + (row % vol->dimY) * vol->strideY;
+
+	if (vol->packing == VOLUME_PACKING_BITS) {
+		return findPackedRowRuns((const uint64_t *)vol->data + offset, vol->dimX, runs);
+	}
+	return findRowRuns((const char *)vol->data + offset * vol->elemSize, vol->elemSize, vol->dimX, runs);
+}
+
+/* Write a row of n elements of elemSize bytes: the runs r0 up to r1 get the
+   label labels[r] of their object, all other voxels get 0. */
+void paintRowRuns(void *row, size_t elemSize, SizeType n, const struct Run *runs, const SizeType *labels, SizeType r0, SizeType r1)
+{
+	SizeType i = 0, r;
+
+#define PAINT_ROW_RUNS(type) \
+	{ \
+		type *p = (type *)row; \
+		for (r = r0; r < r1; r++) { \
+			const type label = (type)labels[r]; \
+			for (; i < runs[r].iStart; i++) p[i] = 0; \
+			for (; i < runs[r].iEnd; i++) p[i] = label; \
+		} \
+		for (; i < n; i++) p[i] = 0; \
+	}
+	switch (elemSize) {
+	case 1: PAINT_ROW_RUNS(uint8_t); break;
+	case 2: PAINT_ROW_RUNS(uint16_t); break;
+	case 4: PAINT_ROW_RUNS(uint32_t); break;
+	default: PAINT_ROW_RUNS(uint64_t); break;
+	}
+#undef PAINT_ROW_RUNS
+}
+
+/* Merge every run of a0 up to a1 with the runs of b0 up to b1 it overlaps.
+   With reach 1, runs that only touch diagonally along X, one ending right
+   before the other starts, are merged too. Both ranges hold the runs of one
+   row in increasing order, so a single sweep finds all overlaps. */
+void mergeOverlappingRuns(const struct Run *runs, SizeType *parent, SizeType a0, SizeType a1, SizeType b0, SizeType b1, SizeType reach)
+{
+	while (a0 < a1 && b0 < b1) {
+		if (runs[a0].iStart < runs[b0].iEnd + reach && runs[b0].iStart < runs[a0].iEnd + reach) {
+			ufUnion(parent, a0, b0);
+		}
+		if (runs[a0].iEnd < runs[b0].iEnd) a0++;
+		else b0++;
+	}
+}
+
+/* Merge the runs of plane k, of dimY rows, with the overlapping runs of
+   plane k - 1, and for 18- and 26-connectivity with those of its rows above
+   and below. */
+void mergePlaneRuns(const struct Run *runs, SizeType *parent, const SizeType *rowStart, SizeType k, SizeType dimY, int connectivity)
+{
+	const SizeType faceReach = connectivity == 6 ? 0 : 1, diagonalReach = connectivity == 26 ? 1 : 0;
+	SizeType j;
+
+	for (j = 0; j < dimY; j++) {
+		const SizeType row = k * dimY + j;
+
+		mergeOverlappingRuns(runs, parent, rowStart[row - dimY], rowStart[row - dimY + 1], rowStart[row], rowStart[row + 1], faceReach);
+		if (connectivity == 6) continue;
+		if (j >= 1) {
+			mergeOverlappingRuns(runs, parent, rowStart[row - dimY - 1], rowStart[row - dimY], rowStart[row], rowStart[row + 1], diagonalReach);
+		}
+		if (j < dimY - 1) {
+			mergeOverlappingRuns(runs, parent, rowStart[row - dimY + 1], rowStart[row - dimY + 2], rowStart[row], rowStart[row + 1], diagonalReach);
+		}
+	}
+}
+
+/* Encode every row of vol, which holds nonzero values or, when bit-packed,
+   set bits for object voxels, as runs, merge runs that touch in a neighboring row or plane, and label the
+   runs. With 6-connectivity only runs in the rows above and below and in the
+   planes in front and behind that overlap touch. 18-connectivity adds the
+   diagonal rows and runs diagonal along X in the other rows; 26-connectivity
+   adds runs diagonal along X in the diagonal rows. Labels start at 2 and are
+   numbered in order of the first run of each object. Return the number of
+   objects. */
+SizeType labelRuns(const struct Volume *vol, struct RunTable *table, int connectivity)
+{
+	const SizeType faceReach = connectivity == 6 ? 0 : 1;
+	const SizeType dimY = vol->dimY, dimZ = vol->dimZ;
+	const SizeType nRows = dimY * dimZ;
+	SizeType *rowStart, *parent;
+	struct Run *runs;
+	SizeType row, runCount, slab, nSlabs = 1;
+
+	checkConnectivity(connectivity);
+
+	/* Count the runs of each row, then turn the counts into the offset of the
+	   first run of each row. */
+	rowStart = (SizeType *)malloc((nRows + 1) * sizeof(SizeType));
+	if (rowStart == NULL) {
+		printf("Failed to allocate the row table. \n");
+		exit(1);
+	}
+	rowStart[0] = 0;
+#pragma omp parallel for schedule(dynamic, 64)
+	for (row = 0; row < nRows; row++) {
+		rowStart[row + 1] = findVolumeRowRuns(vol, row, NULL);
+	}
+	for (row = 0; row < nRows; row++) {
+		rowStart[row + 1] += rowStart[row];
+	}
+	runCount = rowStart[nRows];
+
+	runs = (struct Run *)malloc((runCount + 1) * sizeof(struct Run));
+	parent = (SizeType *)malloc((runCount + 1) * sizeof(SizeType));
+	if (runs == NULL || parent == NULL) {
+		printf("Failed to allocate the run table for %td runs. \n", runCount);
+		exit(1);
+	}
+#pragma omp parallel for schedule(dynamic, 64)
+	for (row = 0; row < nRows; row++) {
+		SizeType r;
+		findVolumeRowRuns(vol, row, runs + rowStart[row]);
+		for (r = rowStart[row]; r < rowStart[row + 1]; r++) {
+			parent[r] = r;
+		}
+	}
+
+	/* Merge runs with the overlapping runs of the previous row and plane.
+	   Every thread merges the planes of a slab of its own, whose runs are
+	   contiguous in the table, so the union-find trees of the threads never
+	   meet. Only the first plane of each slab is merged with the plane
+	   before it afterwards, serially. */
+#pragma omp parallel
+	{
+		SizeType j, k, kMin, kMax;
+
+		if (omp_get_thread_num() == 0) nSlabs = omp_get_num_threads();
+		getSlab(dimZ, omp_get_num_threads(), omp_get_thread_num(), &kMin, &kMax);
+		for (k = kMin; k < kMax; k++) {
+			for (j = 1; j < dimY; j++) {
+				const SizeType r = k * dimY + j;
+				mergeOverlappingRuns(runs, parent, rowStart[r - 1], rowStart[r], rowStart[r], rowStart[r + 1], faceReach);
+			}
+			if (k > kMin) mergePlaneRuns(runs, parent, rowStart, k, dimY, connectivity);
+		}
+	}
+	for (slab = 1; slab < nSlabs; slab++) {
+		SizeType kMin, kMax;
+
+		getSlab(dimZ, nSlabs, slab, &kMin, &kMax);
+		if (kMin < kMax) mergePlaneRuns(runs, parent, rowStart, kMin, dimY, connectivity);
+	}
+
+	table->rowStart = rowStart;
+	table->runs = runs;
+	table->parent = parent;
+	table->runCount = runCount;
+	return resolveLabels(parent, runCount);
+}
+
+/* Paint the labels of the runs into labelVol, one row per task, writing
+   every voxel exactly once. */
+void paintRuns(const struct RunTable *table, struct Volume *labelVol)
+{
+	char *data = (char *)labelVol->data;
+	const SizeType dimY = labelVol->dimY, nRows = labelVol->dimY * labelVol->dimZ;
+	SizeType row;
+
+	labelVol->zeroed = 0;
+#pragma omp parallel for schedule(dynamic, 64)
+	for (row = 0; row < nRows; row++) {
+		char *dst = data + ((row / dimY) * labelVol->strideZ + (row % dimY) * labelVol->strideY) * labelVol->elemSize;
+		paintRowRuns(dst, labelVol->elemSize, labelVol->dimX, table->runs, table->parent,
+			table->rowStart[row], table->rowStart[row + 1]);
+	}
+}
+
+/* Gather the statistics of the objectCount objects of a labeled run table of
+   an image of dimX * dimY * dimZ voxels into stats, which is allocated here,
+   from the runs alone: every run adds its extent to its object, so no voxel
+   of the image is read. When tables per thread would not fit, see
+   threadAccumulatorsFit, a single thread adds all runs to one table. */
+void runStats(const struct RunTable *table, SizeType dimX, SizeType dimY, SizeType dimZ, SizeType objectCount, struct ObjectStats *stats)
+{
+	const int nThreads = threadAccumulatorsFit(omp_get_max_threads(), objectCount, dimX * dimY * dimZ) ? omp_get_max_threads() : 1;
+	const SizeType nRows = dimY * dimZ;
+	struct ObjectAccumulator *threadAcc = allocateThreadAccumulators(nThreads, objectCount);
+	SizeType row;
+
+#pragma omp parallel num_threads(nThreads)
+	{
+		struct ObjectAccumulator *acc = threadAcc + (SizeType)omp_get_thread_num() * objectCount;
+
+#pragma omp for schedule(dynamic, 64)
+		for (row = 0; row < nRows; row++) {
+			SizeType r;
+			for (r = table->rowStart[row]; r < table->rowStart[row + 1]; r++) {
+				accumulateRun(acc + table->parent[r] - 2, table->runs[r].iStart, table->runs[r].iEnd, row % dimY, row / dimY);
+			}
+		}
+	}
+	mergeThreadAccumulators(threadAcc, nThreads, objectCount, stats);
+}
+
+void freeRunTable(struct RunTable *table)
+{
+	free(table->parent);
+	free(table->runs);
+	free(table->rowStart);
+}
+
+/* Label the image run by run. Every row is encoded as runs of object voxels,
+   runs that overlap in a neighboring row or plane are merged with a union-find
+   equivalence table over runs, and the global labels are painted back one run
+   at a time. For objects that are long along X this handles far fewer elements
+   than the voxel-based engines. The partition equals that of
+   singlePassLabelingDefault; labels start at 2 and are numbered in order of
+   the first run of each object. Unless stats is NULL, the statistics of the
+   objects are gathered from the runs into stats, which is allocated here.
+   The runs are found in srcVol, which may be bit-packed, and every voxel of
+   dstVol is written, so it needs no preparation; with a NULL srcVol they are
+   found in dstVol, holding a copy of the image. The program exits when the
+   labels do not fit in dstPixelType, see checkLabelCount. */
+void runLengthLabeling(const struct Volume *srcVol, struct Volume *dstVol, int connectivity, struct ObjectStats *stats)
+{
+	struct RunTable table;
+	SizeType objectCount;
+
+	objectCount = labelRuns(srcVol != NULL ? srcVol : dstVol, &table, connectivity);
+	if (reportObjectCounts) printf("Number of objects found: %td\n", objectCount);
+	checkLabelCount(objectCount);
+	paintRuns(&table, dstVol);
+	if (stats != NULL) {
+		runStats(&table, dstVol->dimX, dstVol->dimY, dstVol->dimZ, objectCount, stats);
+	}
+	freeRunTable(&table);
+}
+
+/* Label the source image run by run into labelVol, which is allocated here
+   with labels of 16 bits. They are only promoted to 32 or 64 bits when the
+   number of objects requires it, whatever LABEL_BITS is, so narrow labels
+   save memory without ever wrapping around. Free labelVol with freeVolume.
+   Unless stats is NULL, the statistics of the objects are gathered into it as
+   by runLengthLabeling. Return the number of objects. */
+SizeType runLengthLabelingPromote(const struct Volume *srcVol, struct Volume *labelVol, int connectivity, struct ObjectStats *stats)
+{
+	struct RunTable table;
+	SizeType objectCount;
+	size_t labelSize;
+
+	objectCount = labelRuns(srcVol, &table, connectivity);
+	if (reportObjectCounts) printf("Number of objects found: %td\n", objectCount);
+	labelSize = labelSizeFor(objectCount);
+	allocateVolume(labelVol, srcVol->dimX, srcVol->dimY, srcVol->dimZ, labelSize);
+	paintRuns(&table, labelVol);
+	if (stats != NULL) {
+		runStats(&table, srcVol->dimX, srcVol->dimY, srcVol->dimZ, objectCount, stats);
+	}
+	freeRunTable(&table);
+	return objectCount;
+}
+
+struct FirstVoxel {
+	SizeType index, label;
+};
+
+int compareFirstVoxels(const void *a, const void *b)
+{
+	const SizeType x = ((const struct FirstVoxel *)a)->index, y = ((const struct FirstVoxel *)b)->index;
+	return x < y ? -1 : x > y;
+}
+
+/* Renumber the labels of labelVol in place so that its objects are labeled
+   2, 3, and so on in order of their first voxel in raster order. Two
+   labelings of the same image then hold the same labels if and only if they
+   have the same objects, whatever the engine that made them. Every thread
+   records the first voxel of each label in its own part of the image in its
+   own table, so the pass runs in parallel; the tables take nThreads times
+   the largest label SizeTypes. Return the number of objects. */
+SizeType canonicalizeLabels(struct Volume *labelVol)
+{
+	dstPixelType *data = (dstPixelType *)labelVol->data;
+	const SizeType dimX = labelVol->dimX, dimY = labelVol->dimY, dimZ = labelVol->dimZ;
+	const int maxThreads = omp_get_max_threads();
+	int nThreads = 1;
+	SizeType *firstIndex, *labelMap;
+	struct FirstVoxel *order;
+	SizeType maxLabel = 0, labelCount, objectCount, label, i, j, k;
+
+#pragma omp parallel for collapse(2) private(i) reduction(max:maxLabel)
+	for (k = 0; k < dimZ; k++) {
+		for (j = 0; j < dimY; j++) {
+			const dstPixelType *row = data + k * labelVol->strideZ + j * labelVol->strideY;
+			for (i = 0; i < dimX; i++) {
+				if ((SizeType)row[i] > maxLabel) maxLabel = (SizeType)row[i];
+			}
+		}
+	}
+	labelCount = maxLabel + 1;
+
+	firstIndex = (SizeType *)malloc((size_t)(maxThreads * labelCount) * sizeof(SizeType));
+	if (firstIndex == NULL) {
+		printf("Failed to allocate the first voxel tables for %td labels. \n", labelCount);
+		exit(1);
+	}
+#pragma omp parallel private(i, j, k)
+	{
+		SizeType *first = firstIndex + omp_get_thread_num() * labelCount;
+		SizeType l;
+
+		/* The team may be smaller than maxThreads, so only the tables of
+		   its threads are merged below. */
+		if (omp_get_thread_num() == 0) nThreads = omp_get_num_threads();
+		for (l = 0; l < labelCount; l++) {
+			first[l] = PTRDIFF_MAX;
+		}
+#pragma omp for collapse(2)
+		for (k = 0; k < dimZ; k++) {
+			for (j = 0; j < dimY; j++) {
+				const dstPixelType *row = data + k * labelVol->strideZ + j * labelVol->strideY;
+				const SizeType rowIndex = (k * dimY + j) * dimX;
+				for (i = 0; i < dimX; i++) {
+					if (row[i] != 0 && rowIndex + i < first[row[i]]) first[row[i]] = rowIndex + i;
+				}
+			}
+		}
+	}
+#pragma omp parallel for
+	for (label = 0; label < labelCount; label++) {
+		int t;
+		for (t = 1; t < nThreads; t++) {
+			if (firstIndex[t * labelCount + label] < firstIndex[label]) firstIndex[label] = firstIndex[t * labelCount + label];
+		}
+	}
+
+	/* Number the labels in order of their first voxels. */
+	order = (struct FirstVoxel *)malloc((size_t)labelCount * sizeof(struct FirstVoxel));
+	labelMap = (SizeType *)malloc((size_t)labelCount * sizeof(SizeType));
+	if (order == NULL || labelMap == NULL) {
+		printf("Failed to allocate the label map for %td labels. \n", labelCount);
+		exit(1);
+	}
+	objectCount = 0;
+	for (label = 1; label < labelCount; label++) {
+		if (firstIndex[label] != PTRDIFF_MAX) {
+			order[objectCount].index = firstIndex[label];
+			order[objectCount].label = label;
+			objectCount++;
+		}
+	}
+	qsort(order, (size_t)objectCount, sizeof(struct FirstVoxel), compareFirstVoxels);
+	labelMap[0] = 0;
+	for (label = 0; label < objectCount; label++) {
+		labelMap[order[label].label] = 2 + label;
+	}
+	checkLabelCount(objectCount);
+
+#pragma omp parallel for collapse(2) private(i)
+	for (k = 0; k < dimZ; k++) {
+		for (j = 0; j < dimY; j++) {
+			dstPixelType *row = data + k * labelVol->strideZ + j * labelVol->strideY;
+			for (i = 0; i < dimX; i++) {
+				row[i] = (dstPixelType)labelMap[row[i]];
+			}
+		}
+	}
+
+	free(labelMap);
+	free(order);
+	free(firstIndex);
+	return objectCount;
+}
+
+/* Print the size, first voxel and bounding box of the object labeled label
+   in labelVol, as found by the engine called name. */
+void describeObject(const struct Volume *labelVol, SizeType label, const char *name)
+{
+	const dstPixelType *data = (const dstPixelType *)labelVol->data;
+	SizeType voxelCount = 0, first = PTRDIFF_MAX, iMin = PTRDIFF_MAX, jMin = PTRDIFF_MAX, kMin = PTRDIFF_MAX, iMax = -1, jMax = -1, kMax = -1;
+	SizeType i, j, k;
+
+#pragma omp parallel for collapse(2) private(i) reduction(+:voxelCount) reduction(min:first, iMin, jMin, kMin) reduction(max:iMax, jMax, kMax)
+	for (k = 0; k < labelVol->dimZ; k++) {
+		for (j = 0; j < labelVol->dimY; j++) {
+			const dstPixelType *row = data + k * labelVol->strideZ + j * labelVol->strideY;
+			for (i = 0; i < labelVol->dimX; i++) {
+				if ((SizeType)row[i] != label) continue;
+				voxelCount++;
+				if ((k * labelVol->dimY + j) * labelVol->dimX + i < first) first = (k * labelVol->dimY + j) * labelVol->dimX + i;
+				if (i < iMin) iMin = i;
+				if (i > iMax) iMax = i;
+				if (j < jMin) jMin = j;
+				if (j > jMax) jMax = j;
+				if (k < kMin) kMin = k;
+				if (k > kMax) kMax = k;
+			}
+		}
+	}
+	if (label == 0) {
+		printf("  %s: background\n", name);
+		return;
+	}
+	printf("  %s: object %td of %td voxels, first voxel (%td, %td, %td), box [%td, %td] x [%td, %td] x [%td, %td]\n",
+		name, label, voxelCount, first % labelVol->dimX, first / labelVol->dimX % labelVol->dimY, first / (labelVol->dimX * labelVol->dimY),
+		iMin, iMax, jMin, jMax, kMin, kMax);
+}
+
+/* Check that two labelings of the same image, made by the engines called
+   aName and bName, have the same objects. Both are canonicalized in place and
+   compared voxel by voxel. At the first voxel, in raster order, where they
+   differ, the objects of both labelings holding that voxel are described.
+   Return 1 if the labelings agree. */
+int compareLabelings(struct Volume *aVol, struct Volume *bVol, const char *aName, const char *bName)
+{
+	const dstPixelType *a = (const dstPixelType *)aVol->data, *b = (const dstPixelType *)bVol->data;
+	SizeType firstMismatch = PTRDIFF_MAX, i, j, k;
+
+	if (aVol->dimX != bVol->dimX || aVol->dimY != bVol->dimY || aVol->dimZ != bVol->dimZ) {
+		printf("%s and %s labeled images of different sizes.\n", aName, bName);
+		return 0;
+	}
+	canonicalizeLabels(aVol);
+	canonicalizeLabels(bVol);
+
+#pragma omp parallel for collapse(2) private(i) reduction(min:firstMismatch)
+	for (k = 0; k < aVol->dimZ; k++) {
+		for (j = 0; j < aVol->dimY; j++) {
+			const dstPixelType *aRow = a + k * aVol->strideZ + j * aVol->strideY;
+			const dstPixelType *bRow = b + k * bVol->strideZ + j * bVol->strideY;
+			for (i = 0; i < aVol->dimX; i++) {
+				if (aRow[i] != bRow[i]) {
+					if ((k * aVol->dimY + j) * aVol->dimX + i < firstMismatch) firstMismatch = (k * aVol->dimY + j) * aVol->dimX + i;
+					break;
+				}
+			}
+		}
+	}
+	if (firstMismatch == PTRDIFF_MAX) {
+		return 1;
+	}
+
+	i = firstMismatch % aVol->dimX;
+	j = firstMismatch / aVol->dimX % aVol->dimY;
+	k = firstMismatch / (aVol->dimX * aVol->dimY);
+	printf("%s and %s differ first at voxel (%td, %td, %td):\n", aName, bName, i, j, k);
+	describeObject(aVol, (SizeType)a[k * aVol->strideZ + j * aVol->strideY + i], aName);
+	describeObject(bVol, (SizeType)b[k * bVol->strideZ + j * bVol->strideY + i], bName);
+	return 0;
+}
+
+/*Print a 2D slice of an 3D image, where the z-direction is kept constant. */
+void printZSliceSource(const struct Volume *srcVol, SizeType k)
+{
+	const srcPixelType *srcData = (const srcPixelType *)srcVol->data;
+	if (k < 0)
+	{
+		printf("Index out of range\n");
+		return;
+	}
+	if (k >= srcVol->dimZ)
+	{
+		printf("Index out of range\n");
+		return;
+	}
+	SizeType i, j;
+	for (j = 0; j < srcVol->dimY; j++)
+	{
+		for (i = 0; i < srcVol->dimX; i++)
+		{
+			printf("%i ", srcData[k * srcVol->strideZ + j * srcVol->strideY + i]);
+		}
+		printf("\n");
+
+	}
+	printf("\n");
+}
+
+void printZSliceDestination(const struct Volume *dstVol, SizeType k)
+{
+	const dstPixelType *dstData = (const dstPixelType *)dstVol->data;
+	if (k < 0)
+	{
+		printf("Index out of range\n");
+		return;
+	}
+	if (k >= dstVol->dimZ)
+	{
+		printf("Index out of range\n");
+		return;
+	}
+	SizeType i, j;
+	for (j = 0; j < dstVol->dimY; j++)
+	{
+		for (i = 0; i < dstVol->dimX; i++)
+		{
+			printf("%td ", (SizeType)dstData[k * dstVol->strideZ + j * dstVol->strideY + i]);
+		}
+		printf("\n");
+	}
+	printf("\n");
+}
+
+void freeImages(struct Volume *srcVol, struct Volume *dstVol)
+{
+	freeVolume(srcVol);
+	freeVolume(dstVol);
+}
+
+/* A labeling engine that labels srcVol into dstVol, whatever dstVol holds,
+   as all engines taking a source and a destination image do. */
+typedef void (*LabelingEngine)(const struct Volume *srcVol, struct Volume *dstVol, int connectivity, struct ObjectStats *stats);
+
+struct NamedEngine {
+	const char     *name;
+	LabelingEngine  engine;
+};
+
+static const struct NamedEngine labelingEngines[] = {
+	{ "single-pass", singlePassLabelingDefault },
+	{ "span", singlePassLabelingSpan },
+	{ "block", blockUnionFindLabelingDefault },
+	{ "slab", parallelEdgeFirstSinglePassLabeling },
+	{ "run-length", runLengthLabeling }
+};
+#define ENGINE_COUNT ((int)(sizeof(labelingEngines) / sizeof(labelingEngines[0])))
+
+/* The engine of labelingEngines called name, or NULL. */
+const struct NamedEngine *findEngine(const char *name)
+{
+	int e;
+
+	for (e = 0; e < ENGINE_COUNT; e++) {
+		if (strcmp(name, labelingEngines[e].name) == 0) return &labelingEngines[e];
+	}
+	return NULL;
+}
+
+/* Wall-clock times of repeated trials of one phase, in seconds. */
+struct PhaseTimes {
+	const char *engine;
+	const char *phase;
+	int         threads;
+	int         trials;
+	double      min, p10, median, p90, max;
+};
+
+int compareDoubles(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Summarize the times of n trials, which are sorted in place. Percentiles
+   are taken by nearest rank. */
+void summarizeTimes(double *times, int n, struct PhaseTimes *result)
+{
+	qsort(times, (size_t)n, sizeof(double), compareDoubles);
+	result->trials = n;
+	result->min = times[0];
+	result->p10 = times[(n - 1) / 10];
+	result->median = n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+	result->p90 = times[n - 1 - (n - 1) / 10];
+	result->max = times[n - 1];
+}
+
+/* Write s as a JSON string, escaping quotes and backslashes, as in Windows
+   paths. */
+void writeJsonString(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') fputc('\\', fp);
+		fputc(*s, fp);
+	}
+	fputc('"', fp);
+}
+
+void writeBenchJson(const char *fname, const char *image, const struct Volume *srcVol, int connectivity, int warmup,
+	const struct PhaseTimes *results, int resultCount)
+{
+	FILE *fp = fopen(fname, "w");
+	int r;
+
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", fname);
+		exit(1);
+	}
+	fprintf(fp, "{\n  \"image\": ");
+	writeJsonString(fp, image);
+	fprintf(fp, ",\n  \"dims\": [%td, %td, %td],\n  \"connectivity\": %d,\n  \"label_bits\": %d,\n"
+		"  \"warmup\": %d,\n  \"results\": [\n", srcVol->dimX, srcVol->dimY, srcVol->dimZ, connectivity, LABEL_BITS, warmup);
+	for (r = 0; r < resultCount; r++) {
+		const struct PhaseTimes *t = &results[r];
+		fprintf(fp, "    {\"engine\": \"%s\", \"phase\": \"%s\", \"threads\": %d, \"trials\": %d, "
+			"\"min\": %.9f, \"p10\": %.9f, \"median\": %.9f, \"p90\": %.9f, \"max\": %.9f}%s\n",
+			t->engine, t->phase, t->threads, t->trials, t->min, t->p10, t->median, t->p90, t->max, r + 1 < resultCount ? "," : "");
+	}
+	fprintf(fp, "  ]\n}\n");
+	fclose(fp);
+}
+
+void writeBenchCsv(const char *fname, const struct PhaseTimes *results, int resultCount)
+{
+	FILE *fp = fopen(fname, "w");
+	int r;
+
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", fname);
+		exit(1);
+	}
+	fprintf(fp, "engine,phase,threads,trials,min,p10,median,p90,max\n");
+	for (r = 0; r < resultCount; r++) {
+		const struct PhaseTimes *t = &results[r];
+		fprintf(fp, "%s,%s,%d,%d,%.9f,%.9f,%.9f,%.9f,%.9f\n",
+			t->engine, t->phase, t->threads, t->trials, t->min, t->p10, t->median, t->p90, t->max);
+	}
+	fclose(fp);
+}
+
+/* Parse a comma-separated list of thread counts into threadCounts. Return
+   the number of counts. */
+int parseThreadCounts(const char *list, int threadCounts[BENCH_MAX_THREAD_COUNTS])
+{
+	int n = 0;
+
+	while (*list != '\0') {
+		char *end;
+		long t = strtol(list, &end, 10);
+
+		if (end == list || t < 1 || n == BENCH_MAX_THREAD_COUNTS) {
+			printf("Invalid thread count list %s.\n", list);
+			exit(1);
+		}
+		threadCounts[n++] = (int)t;
+		list = *end == ',' ? end + 1 : end;
+	}
+	return n;
+}
+
+/* Where the benchmark and the checker get their image: a volume file, a
+   volume generated in memory, or, by default, the ascii image FNAME. */
+struct ImageSource {
+	const char *fileName, *pattern;
+	SizeType    dims[3], size;
+	double      density;
+	uint64_t    seed;
+};
+
+void initImageSource(struct ImageSource *source)
+{
+	memset(source, 0, sizeof(*source));
+	source->size = GENERATOR_SIZE;
+	source->density = GENERATOR_DENSITY;
+}
+
+/* If argv[*a] selects the image, consume it, with its arguments, and return
+   1. Options are --generate pattern dimX dimY dimZ, --seed N, --density p
+   and --size s; any other argument not starting with - names a volume
+   file. */
+int parseImageSourceOption(int argc, char *argv[], int *a, struct ImageSource *source)
+{
+	if (*a + 4 < argc && strcmp(argv[*a], "--generate") == 0) {
+		source->pattern = argv[++*a];
+		source->dims[0] = (SizeType)atoll(argv[++*a]);
+		source->dims[1] = (SizeType)atoll(argv[++*a]);
+		source->dims[2] = (SizeType)atoll(argv[++*a]);
+	}
+	else if (*a + 1 < argc && strcmp(argv[*a], "--seed") == 0) source->seed = (uint64_t)strtoull(argv[++*a], NULL, 10);
+	else if (*a + 1 < argc && strcmp(argv[*a], "--density") == 0) source->density = atof(argv[++*a]);
+	else if (*a + 1 < argc && strcmp(argv[*a], "--size") == 0) source->size = (SizeType)atoll(argv[++*a]);
+	else if (argv[*a][0] != '-') source->fileName = argv[*a];
+	else return 0;
+	return 1;
+}
+
+/* Load or generate the image into srcVol, and allocate a destination image
+   of the same size. Return the name of the image. */
+const char *loadImageSource(const struct ImageSource *source, struct Volume *srcVol, struct Volume *dstVol)
+{
+	if (source->pattern != NULL) {
+		struct Generator gen;
+
+		initGenerator(&gen, source->pattern, source->seed, source->density, source->size, source->dims[0], source->dims[1], source->dims[2]);
+		allocateVolume(srcVol, source->dims[0], source->dims[1], source->dims[2], sizeof(srcPixelType));
+		allocateZeroedVolume(dstVol, source->dims[0], source->dims[1], source->dims[2], sizeof(dstPixelType));
+		generateVolume(&gen, srcVol, 0);
+		freeGenerator(&gen);
+		return source->pattern;
+	}
+	if (source->fileName != NULL) {
+		mapVolumeFile(source->fileName, srcVol, sizeof(srcPixelType));
+		allocateZeroedVolume(dstVol, srcVol->dimX, srcVol->dimY, srcVol->dimZ, sizeof(dstPixelType));
+		return source->fileName;
+	}
+	allocateImages(srcVol, dstVol);
+	readSrcImg(srcVol);
+	return FNAME;
+}
+
+/* Benchmark the labeling engines on one image with wall-clock timing:
+
+     Parallel_Labeling [--connectivity C] --bench [options] [volume.vol]
+
+   Without a volume file the ascii image FNAME is read. Options:
+     --generate pattern dimX dimY dimZ
+                       generate the image in memory instead, see struct
+                       Generator, with --seed N (0), --density p
+                       (GENERATOR_DENSITY) and --size s (GENERATOR_SIZE)
+     --trials N        timed trials per engine and thread count (BENCH_TRIALS)
+     --warmup N        untimed runs before the trials (BENCH_WARMUP)
+     --threads 1,2,8   thread counts to sweep (powers of two up to the
+                       maximum, and the maximum)
+     --engine name     only this engine of labelingEngines
+     --json file       write the results as JSON
+     --csv file        write the results as CSV
+
+   For every thread count, the trials time the phases that do not depend on
+   the engine: load, loading or generating the image and allocating the
+   destination image, and stats, gathering the object statistics from labels
+   in a pass of its own, see labelStats. Then for every engine they time
+   labeling the image into the destination image, and labeling it while
+   gathering object statistics, as the phases label and label+stats. Both
+   include whatever preparation of the destination image the engine needs,
+   such as prepareFloodSource. The thread count of the caller is restored
+   afterwards. */
+void runBenchmark(int argc, char *argv[], int connectivity)
+{
+	struct Volume srcVol, dstVol;
+	struct ObjectStats stats;
+	struct ImageSource source;
+	const char *image, *jsonName = NULL, *csvName = NULL, *engineName = NULL;
+	int trials = BENCH_TRIALS, warmup = BENCH_WARMUP;
+	int threadCounts[BENCH_MAX_THREAD_COUNTS], threadCountCount = 0;
+	struct PhaseTimes *results;
+	int resultCount = 0, a, e, tc, trial, phase;
+	const int callerThreads = omp_get_max_threads();
+	double *times[2];
+
+	initImageSource(&source);
+	for (a = 0; a < argc; a++) {
+		if (parseImageSourceOption(argc, argv, &a, &source)) continue;
+		if (a + 1 < argc && strcmp(argv[a], "--trials") == 0) trials = atoi(argv[++a]);
+		else if (a + 1 < argc && strcmp(argv[a], "--warmup") == 0) warmup = atoi(argv[++a]);
+		else if (a + 1 < argc && strcmp(argv[a], "--threads") == 0) threadCountCount = parseThreadCounts(argv[++a], threadCounts);
+		else if (a + 1 < argc && strcmp(argv[a], "--engine") == 0) engineName = argv[++a];
+		else if (a + 1 < argc && strcmp(argv[a], "--json") == 0) jsonName = argv[++a];
+		else if (a + 1 < argc && strcmp(argv[a], "--csv") == 0) csvName = argv[++a];
+		else {
+			printf("Unknown benchmark option %s.\n", argv[a]);
+			exit(1);
+		}
+	}
+	if (trials < 1 || warmup < 0) {
+		printf("The benchmark needs at least one trial.\n");
+		exit(1);
+	}
+	if (engineName != NULL && findEngine(engineName) == NULL) {
+		printf("Unknown engine %s.\n", engineName);
+		exit(1);
+	}
+	if (threadCountCount == 0) {
+		const int maxThreads = omp_get_max_threads();
+		int t;
+		for (t = 1; t < maxThreads && threadCountCount < BENCH_MAX_THREAD_COUNTS - 1; t *= 2) {
+			threadCounts[threadCountCount++] = t;
+		}
+		threadCounts[threadCountCount++] = maxThreads;
+	}
+
+	image = loadImageSource(&source, &srcVol, &dstVol);
+	results = (struct PhaseTimes *)malloc((2 + 2 * ENGINE_COUNT) * threadCountCount * sizeof(struct PhaseTimes));
+	for (phase = 0; phase < 2; phase++) {
+		times[phase] = (double *)malloc((size_t)trials * sizeof(double));
+	}
+	if (results == NULL || times[0] == NULL || times[1] == NULL) {
+		printf("Failed to allocate the benchmark results. \n");
+		exit(1);
+	}
+
+	printf("Dims: %td, %td, %td, connectivity %d, %d-bit labels\n", srcVol.dimX, srcVol.dimY, srcVol.dimZ, connectivity, LABEL_BITS);
+	if (numaFirstTouch) {
+		reportPagePlacement(&srcVol, "the source image");
+		reportPagePlacement(&dstVol, "the destination image");
+	}
+	printf("%-12s %-12s %8s %12s %12s %12s\n", "engine", "phase", "threads", "median", "p10", "p90");
+
+	reportObjectCounts = 0;
+	for (tc = 0; tc < threadCountCount; tc++) {
+		static const char *phaseNames[2] = { "load", "stats" };
+
+		omp_set_num_threads(threadCounts[tc]);
+		for (trial = -warmup; trial < trials; trial++) {
+			double t0;
+
+			t0 = omp_get_wtime();
+			freeImages(&srcVol, &dstVol);
+			loadImageSource(&source, &srcVol, &dstVol);
+			if (trial >= 0) times[0][trial] = omp_get_wtime() - t0;
+		}
+		singlePassLabelingDefault(&srcVol, &dstVol, connectivity, &stats);
+		for (trial = -warmup; trial < trials; trial++) {
+			struct ObjectStats passStats;
+			double t0;
+
+			t0 = omp_get_wtime();
+			labelStats(&dstVol, stats.objectCount, &passStats);
+			if (trial >= 0) times[1][trial] = omp_get_wtime() - t0;
+			freeObjectStats(&passStats);
+		}
+		freeObjectStats(&stats);
+		for (phase = 0; phase < 2; phase++) {
+			struct PhaseTimes *result = &results[resultCount++];
+
+			result->engine = "";
+			result->phase = phaseNames[phase];
+			result->threads = threadCounts[tc];
+			summarizeTimes(times[phase], trials, result);
+			printf("%-12s %-12s %8d %12.6f %12.6f %12.6f\n", result->engine, result->phase, result->threads,
+				result->median, result->p10, result->p90);
+		}
+	}
+	for (e = 0; e < ENGINE_COUNT; e++) {
+		if (engineName != NULL && strcmp(engineName, labelingEngines[e].name) != 0) continue;
+		for (tc = 0; tc < threadCountCount; tc++) {
+			static const char *phaseNames[2] = { "label", "label+stats" };
+
+			omp_set_num_threads(threadCounts[tc]);
+			for (trial = -warmup; trial < trials; trial++) {
+				double t0, t1;
+
+				t0 = omp_get_wtime();
+				labelingEngines[e].engine(&srcVol, &dstVol, connectivity, NULL);
+				t1 = omp_get_wtime();
+				labelingEngines[e].engine(&srcVol, &dstVol, connectivity, &stats);
+				freeObjectStats(&stats);
+				if (trial >= 0) {
+					times[0][trial] = t1 - t0;
+					times[1][trial] = omp_get_wtime() - t1;
+				}
+			}
+			for (phase = 0; phase < 2; phase++) {
+				struct PhaseTimes *result = &results[resultCount++];
+
+				result->engine = labelingEngines[e].name;
+				result->phase = phaseNames[phase];
+				result->threads = threadCounts[tc];
+				summarizeTimes(times[phase], trials, result);
+				printf("%-12s %-12s %8d %12.6f %12.6f %12.6f\n", result->engine, result->phase, result->threads,
+					result->median, result->p10, result->p90);
+			}
+		}
+	}
+	reportObjectCounts = 1;
+	omp_set_num_threads(callerThreads);
+
+	if (jsonName != NULL) writeBenchJson(jsonName, image, &srcVol, connectivity, warmup, results, resultCount);
+	if (csvName != NULL) writeBenchCsv(csvName, results, resultCount);
+	for (phase = 0; phase < 2; phase++) {
+		free(times[phase]);
+	}
+	free(results);
+	freeImages(&srcVol, &dstVol);
+}
+
+/* Make byteVol an unpacked and bitVol a bit-packed copy of srcVol, which
+   may be either. Both are allocated here; free them with freeVolume. */
+void copyWithBothPackings(const struct Volume *srcVol, struct Volume *byteVol, struct Volume *bitVol)
+{
+	const SizeType dimX = srcVol->dimX, dimY = srcVol->dimY, dimZ = srcVol->dimZ;
+	SizeType i, j, k;
+
+	allocateVolume(byteVol, dimX, dimY, dimZ, sizeof(srcPixelType));
+	allocatePackedVolume(bitVol, dimX, dimY, dimZ);
+#pragma omp parallel for collapse(2) private(i)
+	for (k = 0; k < dimZ; k++) {
+		for (j = 0; j < dimY; j++) {
+			const char *src = (const char *)srcVol->data + (k * srcVol->strideZ + j * srcVol->strideY) * srcVol->elemSize;
+			srcPixelType *bytes = (srcPixelType *)byteVol->data + k * byteVol->strideZ + j * byteVol->strideY;
+			uint64_t *words = (uint64_t *)bitVol->data + k * bitVol->strideZ + j * bitVol->strideY;
+
+			memset(words, 0, (size_t)packedRowWords(dimX) * sizeof(uint64_t));
+			for (i = 0; i < dimX; i++) {
+				const int set = srcVol->packing == VOLUME_PACKING_BITS ? (int)(((const uint64_t *)src)[i / 64] >> (i % 64) & 1)
+					: ((const srcPixelType *)src)[i] != 0;
+				bytes[i] = (srcPixelType)set;
+				if (set) words[i / 64] |= (uint64_t)1 << (i % 64);
+			}
+		}
+	}
+}
+
+/* Check the neighbor counts of process, with the interior row kernel chosen
+   for this CPU, and of processPacked, against counting every voxel with
+   bounds checks, as countNeighborsChecked does, and check the histograms of
+   neighborHistogram and neighborHistogramPacked, and of streamProcess on
+   streamName unless it is NULL, against the histogram of those counts.
+   Return the number of disagreements. */
+int checkNeighborCounts(const struct Volume *byteVol, const struct Volume *bitVol, const char *streamName, int connectivity)
+{
+	const srcPixelType *srcData = (const srcPixelType *)byteVol->data;
+	const SizeType dimX = byteVol->dimX, dimY = byteVol->dimY, dimZ = byteVol->dimZ, voxels = dimX * dimY * dimZ;
+	struct Volume refVol, countVol;
+	SizeType refSums[MAX_NEIGHBORS + 1], sums[MAX_NEIGHBORS + 1], x, i, j, k;
+	int failures = 0, n, kernel;
+
+	allocateVolume(&refVol, dimX, dimY, dimZ, sizeof(dstPixelType));
+	allocateVolume(&countVol, dimX, dimY, dimZ, sizeof(dstPixelType));
+#pragma omp parallel for collapse(2) private(i)
+	for (k = 0; k < dimZ; k++) {
+		for (j = 0; j < dimY; j++) {
+			const srcPixelType *src = srcData + k * byteVol->strideZ + j * byteVol->strideY;
+			const srcPixelType *below = k >= 1 ? src - byteVol->strideZ : NULL, *above = k < dimZ - 1 ? src + byteVol->strideZ : NULL;
+			dstPixelType *ref = (dstPixelType *)refVol.data + k * refVol.strideZ + j * refVol.strideY;
+			for (i = 0; i < dimX; i++) {
+				ref[i] = connectivity == 6 ? countNeighborsChecked(src, below, above, i, j, dimX, dimY, byteVol->strideY)
+					: countNeighborsCheckedConnected(src, below, above, i, j, dimX, dimY, byteVol->strideY, connectivity);
+			}
+		}
+	}
+	for (n = 0; n <= MAX_NEIGHBORS; n++) refSums[n] = 0;
+	for (x = 0; x < voxels; x++) {
+		refSums[((const dstPixelType *)refVol.data)[x]]++;
+	}
+
+	for (kernel = 0; kernel < 2; kernel++) {
+		const char *name = kernel == 0 ? "process" : "processPacked";
+
+		if (kernel == 0) process(byteVol, &countVol, connectivity);
+		else processPacked(bitVol, &countVol, connectivity);
+		if (memcmp(countVol.data, refVol.data, (size_t)voxels * sizeof(dstPixelType)) != 0) {
+			for (x = 0; ((const dstPixelType *)countVol.data)[x] == ((const dstPixelType *)refVol.data)[x]; x++);
+			printf("%s: counts %td neighbors at voxel (%td, %td, %td), not %td\n", name, (SizeType)((const dstPixelType *)countVol.data)[x],
+				x % dimX, (x / dimX) % dimY, x / (dimX * dimY), (SizeType)((const dstPixelType *)refVol.data)[x]);
+			failures++;
+		}
+		else {
+			printf("%s: counts agree\n", name);
+		}
+	}
+	for (kernel = 0; kernel < 3; kernel++) {
+		const char *name = kernel == 0 ? "neighborHistogram" : kernel == 1 ? "neighborHistogramPacked" : "streamProcess";
+
+		if (kernel == 0) neighborHistogram(byteVol, sums, connectivity);
+		else if (kernel == 1) neighborHistogramPacked(bitVol, sums, connectivity);
+		else if (streamName != NULL) streamProcess(streamName, 0, 0, 0, NULL, connectivity, sums);
+		else continue;
+		for (n = 0; n <= connectivity && sums[n] == refSums[n]; n++);
+		if (n <= connectivity) {
+			printf("%s: counts %td voxels with %d neighbors, not %td\n", name, sums[n], n, refSums[n]);
+			failures++;
+		}
+		else {
+			printf("%s: histogram agrees\n", name);
+		}
+	}
+	freeVolume(&refVol);
+	freeVolume(&countVol);
+	return failures;
+}
+
+/* Check incremental relabeling against labeling from scratch: byteVol, an
+   unpacked image, is labeled by reference, and then for CHECK_EDIT_ROUNDS
+   rounds a deterministic set of voxels, scattered ones and a run along X, is
+   toggled, the labels are updated with relabelEdits, and compared with
+   labeling the edited image by reference into refVol. byteVol is edited in
+   place. Return the number of rounds that disagree. */
+int checkRelabeling(struct Volume *byteVol, struct Volume *labelVol, struct Volume *refVol, const struct NamedEngine *reference,
+	int connectivity)
+{
+	srcPixelType *srcData = (srcPixelType *)byteVol->data;
+	const SizeType dimX = byteVol->dimX, voxels = dimX * byteVol->dimY * byteVol->dimZ;
+	const SizeType scattered = 1 + voxels / 4096, runLength = dimX < 16 ? dimX : 16;
+	struct Volume copyVol;
+	struct LabelChanges changes;
+	SizeType *changed, nextLabel, x;
+	int failures = 0, round;
+
+	changed = (SizeType *)malloc((size_t)(scattered + runLength) * sizeof(SizeType));
+	if (changed == NULL) {
+		printf("Failed to allocate the edits of the relabeling check. \n");
+		exit(1);
+	}
+	memset(&changes, 0, sizeof(changes));
+	allocateVolume(&copyVol, byteVol->dimX, byteVol->dimY, byteVol->dimZ, sizeof(dstPixelType));
+	reference->engine(byteVol, labelVol, connectivity, NULL);
+	nextLabel = canonicalizeLabels(labelVol) + 2;
+
+	for (round = 0; round < CHECK_EDIT_ROUNDS; round++) {
+		const SizeType runStart = (SizeType)(hash64(0x5EED0000u + 2 * round + 1) % (uint64_t)voxels) / dimX * dimX;
+		char name[64];
+
+		for (x = 0; x < scattered; x++) {
+			changed[x] = (SizeType)(hash64((uint64_t)round << 32 | (uint64_t)x) % (uint64_t)voxels);
+		}
+		for (x = 0; x < runLength; x++) {
+			changed[scattered + x] = runStart + x;
+		}
+		for (x = 0; x < scattered + runLength; x++) {
+			srcData[changed[x]] = (srcPixelType)!srcData[changed[x]];
+		}
+		checkLabelingResult(relabelEdits(byteVol, labelVol, changed, scattered + runLength, connectivity, &nextLabel, &changes));
+		reference->engine(byteVol, refVol, connectivity, NULL);
+		memcpy(copyVol.data, labelVol->data, (size_t)voxels * sizeof(dstPixelType));
+		sprintf(name, "relabel round %d", round + 1);
+		if (!compareLabelings(refVol, &copyVol, reference->name, name)) failures++;
+	}
+	if (failures == 0) printf("relabel: agrees with %s in %d rounds of edits\n", reference->name, CHECK_EDIT_ROUNDS);
+
+	freeVolume(&copyVol);
+	freeLabelChanges(&changes);
+	free(changed);
+	return failures;
+}
+
+struct LabelingWorkspace {
+	struct Volume       labels;           /* Labels of the last call, in memory for labelCapacity voxels. */
+	SizeType            labelCapacity;
+	struct BlockTables  tables;
+	struct ObjectStats  stats;
+	struct Volume       histograms;       /* Thread histograms of countImageNeighbors. */
+	struct LabelChanges changes;
+	SizeType            nextLabel;        /* One more than the largest label in labels. */
+	int                 connectivity;     /* Connectivity labels was labeled with. */
+};
+
+struct LabelingWorkspace *createLabelingWorkspace(void)
+{
+	return (struct LabelingWorkspace *)calloc(1, sizeof(struct LabelingWorkspace));
+}
+
+void destroyLabelingWorkspace(struct LabelingWorkspace *workspace)
+{
+	if (workspace == NULL) return;
+	if (workspace->labels.data != NULL) freeVolume(&workspace->labels);
+	if (workspace->histograms.data != NULL) freeVolume(&workspace->histograms);
+	freeBlockTables(&workspace->tables);
+	freeObjectStats(&workspace->stats);
+	freeLabelChanges(&workspace->changes);
+	free(workspace);
+	releaseThreadBuffers();
+}
+
+/* Make vol a volume viewing image, which it does not own: never free it.
+   Return 0, or LABELING_ERROR_ARGUMENT for negative dimensions. */
+SizeType viewImage(struct Volume *vol, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ)
+{
+	if (dimX < 0 || dimY < 0 || dimZ < 0) return LABELING_ERROR_ARGUMENT;
+	vol->data = (void *)image;
+	vol->dimX = dimX;
+	vol->dimY = dimY;
+	vol->dimZ = dimZ;
+	vol->strideY = dimX;
+	vol->strideZ = dimX * dimY;
+	vol->elemSize = sizeof(srcPixelType);
+	vol->packing = VOLUME_PACKING_NONE;
+	vol->zeroed = 0;
+	vol->mapping = NULL;
+	vol->mappingSize = 0;
+	return 0;
+}
+
+/* Shape the label volume of workspace to dimX * dimY * dimZ voxels,
+   reallocating it only when it has less room than that. Return 0, or
+   LABELING_ERROR_MEMORY, leaving the workspace without labels. */
+SizeType reserveLabels(struct LabelingWorkspace *workspace, SizeType dimX, SizeType dimY, SizeType dimZ)
+{
+	struct Volume *labels = &workspace->labels;
+	const SizeType voxels = dimX * dimY * dimZ;
+
+	if (labels->data == NULL || voxels > workspace->labelCapacity) {
+		if (labels->data != NULL) freeVolume(labels);
+		workspace->labelCapacity = 0;
+		if (!tryAllocateVolume(labels, dimX, dimY, dimZ, sizeof(dstPixelType))) return LABELING_ERROR_MEMORY;
+		workspace->labelCapacity = voxels;
+	}
+	labels->dimX = dimX;
+	labels->dimY = dimY;
+	labels->dimZ = dimZ;
+	labels->strideY = dimX;
+	labels->strideZ = dimX * dimY;
+	return 0;
+}
+
+/* Label image into the workspace with the block engine, gathering the
+   object statistics into it unless stats is NULL. Until a labeling
+   succeeds, the workspace has no labels to relabel. */
+SizeType labelImageInWorkspace(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, const dstPixelType **labels, const struct ObjectStats **stats)
+{
+	struct Volume srcVol;
+	SizeType objectCount;
+
+	workspace->connectivity = 0;
+	if (!validConnectivity(connectivity) || viewImage(&srcVol, image, dimX, dimY, dimZ) != 0) return LABELING_ERROR_ARGUMENT;
+	if (reserveLabels(workspace, dimX, dimY, dimZ) != 0) return LABELING_ERROR_MEMORY;
+	objectCount = blockUnionFindLabelingWith(&srcVol, &workspace->labels, BLOCK_DIM_X, BLOCK_DIM_Y, BLOCK_DIM_Z, connectivity,
+		stats != NULL ? &workspace->stats : NULL, &workspace->tables);
+	if (objectCount < 0) return objectCount;
+	*labels = (const dstPixelType *)workspace->labels.data;
+	if (stats != NULL) *stats = &workspace->stats;
+	workspace->nextLabel = objectCount + 2;
+	workspace->connectivity = connectivity;
+	return objectCount;
+}
+
+SizeType labelImage(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, const dstPixelType **labels)
+{
+	return labelImageInWorkspace(workspace, image, dimX, dimY, dimZ, connectivity, labels, NULL);
+}
+
+SizeType labelImageStats(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, const dstPixelType **labels, const struct ObjectStats **stats)
+{
+	return labelImageInWorkspace(workspace, image, dimX, dimY, dimZ, connectivity, labels, stats);
+}
+
+SizeType relabelImage(struct LabelingWorkspace *workspace, const srcPixelType *image, const SizeType *changed, SizeType changedCount,
+	const dstPixelType **labels, const struct LabelChanges **changes)
+{
+	struct Volume srcVol;
+	SizeType objectCount;
+
+	if (workspace->labels.data == NULL || workspace->connectivity == 0) return LABELING_ERROR_ARGUMENT;
+	viewImage(&srcVol, image, workspace->labels.dimX, workspace->labels.dimY, workspace->labels.dimZ);
+	objectCount = relabelEdits(&srcVol, &workspace->labels, changed, changedCount, workspace->connectivity, &workspace->nextLabel,
+		&workspace->changes);
+	if (objectCount < 0) {
+		if (objectCount != LABELING_ERROR_ARGUMENT) workspace->connectivity = 0;
+		return objectCount;
+	}
+	*labels = (const dstPixelType *)workspace->labels.data;
+	*changes = &workspace->changes;
+	return objectCount;
+}
+
+SizeType countImageNeighbors(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, SizeType sums[MAX_NEIGHBORS + 1])
+{
+	struct Volume srcVol;
+
+	if (!validConnectivity(connectivity) || viewImage(&srcVol, image, dimX, dimY, dimZ) != 0) return LABELING_ERROR_ARGUMENT;
+	/* The histograms have a row per thread, so they are reallocated when
+	   more threads may run than when they were allocated. */
+	if (workspace->histograms.data == NULL || workspace->histograms.dimY < omp_get_max_threads()) {
+		if (workspace->histograms.data != NULL) freeVolume(&workspace->histograms);
+		if (!tryAllocateThreadHistograms(&workspace->histograms, MAX_NEIGHBORS + 1)) return LABELING_ERROR_MEMORY;
+	}
+	return neighborHistogramWith(&srcVol, sums, connectivity, &workspace->histograms);
+}
+
+/* One of the two sets of buffers of runBatch: the source image of a
+   volume, and a workspace with its labels and object statistics. */
+struct BatchSlot {
+	struct Volume             src;
+	size_t                    srcCapacity;
+	struct LabelingWorkspace *workspace;
+	SizeType                  objectCount;
+};
+
+/* Read the list of a batch, a text file with a line per volume: the name of
+   the volume file and, optionally, the name of the label file to write.
+   Return the number of volumes; *inNames and *outNames, with NULL for volumes
+   without a label file, point into *text. All three are allocated here; free
+   them with free. */
+SizeType readBatchList(const char *listName, char **text, char ***inNames, char ***outNames)
+{
+	FILE *fp;
+	long length;
+	SizeType volumeCount = 0, lineCount = 1, n;
+	char *line, *end;
+
+	fp = fopen(listName, "rb");
+	if (fp == NULL || fseek(fp, 0, SEEK_END) != 0 || (length = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0) {
+		printf("Failed to open %s for reading. \n", listName);
+		exit(1);
+	}
+	*text = (char *)malloc((size_t)length + 1);
+	if (*text == NULL || fread(*text, 1, (size_t)length, fp) != (size_t)length) {
+		printf("Failed to read %s. \n", listName);
+		exit(1);
+	}
+	fclose(fp);
+	(*text)[length] = '\0';
+	for (n = 0; n < length; n++) {
+		if ((*text)[n] == '\n') lineCount++;
+	}
+	*inNames = (char **)malloc((size_t)lineCount * sizeof(char *));
+	*outNames = (char **)malloc((size_t)lineCount * sizeof(char *));
+	if (*inNames == NULL || *outNames == NULL) {
+		printf("Failed to allocate the batch list. \n");
+		exit(1);
+	}
+
+	/* Split every line in place into at most two names. */
+	for (line = *text; line != NULL; line = end) {
+		char *names[2] = { NULL, NULL }, *c;
+		int nameCount = 0;
+
+		end = strchr(line, '\n');
+		if (end != NULL) *end++ = '\0';
+		for (c = line; *c != '\0';) {
+			while (*c == ' ' || *c == '\t' || *c == '\r') *c++ = '\0';
+			if (*c == '\0') break;
+			if (nameCount == 2) {
+				printf("A line of %s names more than a volume file and a label file. \n", listName);
+				exit(1);
+			}
+			names[nameCount++] = c;
+			while (*c != '\0' && *c != ' ' && *c != '\t' && *c != '\r') c++;
+		}
+		if (nameCount == 0) continue;
+		(*inNames)[volumeCount] = names[0];
+		(*outNames)[volumeCount] = names[1];
+		volumeCount++;
+	}
+	return volumeCount;
+}
+
+/* Label the volumes of a batch list, see readBatchList, as a pipeline: while
+   volume n is labeled, with its object statistics, by all threads, one more
+   thread reads volume n + 1, and writes the labels of volume n - 1 and its
+   statistics, a line per object in the table statsName. Each step ends when
+   both are done, so there are never more than two volumes in memory, and
+   when I/O and labeling take about as long, the batch takes about as long as
+   the larger of them rather than their sum. Volumes are read with
+   readVolumeFile, and labeled with the block engine into workspaces that
+   keep their memory from volume to volume. */
+void runBatch(const char *listName, const char *statsName, int connectivity)
+{
+	struct BatchSlot slots[2];
+	char *text, **inNames, **outNames;
+	SizeType volumeCount, totalObjects = 0;
+	SizeType step;
+	double ioTime = 0.0, labelTime = 0.0, start;
+	int callerLevels, s;
+	FILE *fp;
+
+	volumeCount = readBatchList(listName, &text, &inNames, &outNames);
+	fp = fopen(statsName, "w");
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", statsName);
+		exit(1);
+	}
+	fprintf(fp, "volume,label,voxels,iMin,iMax,jMin,jMax,kMin,kMax,iCentroid,jCentroid,kCentroid\n");
+	memset(slots, 0, sizeof(slots));
+	for (s = 0; s < 2; s++) {
+		slots[s].workspace = createLabelingWorkspace();
+		if (slots[s].workspace == NULL) checkLabelingResult(LABELING_ERROR_MEMORY);
+	}
+
+	/* The labeling of a step runs its parallel regions inside the section
+	   of the step, so nested regions must get threads of their own. */
+	callerLevels = omp_get_max_active_levels();
+	if (callerLevels < 2) omp_set_max_active_levels(2);
+
+	start = omp_get_wtime();
+	for (step = -1; step <= volumeCount; step++) {
+#pragma omp parallel sections num_threads(2)
+		{
+#pragma omp section
+			{
+				const double t0 = omp_get_wtime();
+
+				/* Volumes n - 1 and n + 1 share a slot, so volume n - 1 is
+				   done with first. */
+				if (step - 1 >= 0) {
+					const struct BatchSlot *slot = &slots[(step - 1) % 2];
+					const struct ObjectStats *stats = &slot->workspace->stats;
+					SizeType n;
+
+					for (n = 0; n < stats->objectCount; n++) {
+						fprintf(fp, "%td,%td,%td,%td,%td,%td,%td,%td,%td,%.3f,%.3f,%.3f\n", step - 1, n + 2, stats->voxelCount[n],
+							stats->iMin[n], stats->iMax[n], stats->jMin[n], stats->jMax[n], stats->kMin[n], stats->kMax[n],
+							stats->iCentroid[n], stats->jCentroid[n], stats->kCentroid[n]);
+					}
+					if (outNames[step - 1] != NULL) {
+						writeVolumeFile(outNames[step - 1], &slot->workspace->labels);
+					}
+					printf("%s: %td x %td x %td voxels, %td objects\n", inNames[step - 1],
+						slot->src.dimX, slot->src.dimY, slot->src.dimZ, slot->objectCount);
+				}
+				if (step + 1 < volumeCount) {
+					readVolumeFile(inNames[step + 1], &slots[(step + 1) % 2].src, &slots[(step + 1) % 2].srcCapacity, sizeof(srcPixelType));
+				}
+				ioTime += omp_get_wtime() - t0;
+			}
+#pragma omp section
+			{
+				if (step >= 0 && step < volumeCount) {
+					struct BatchSlot *slot = &slots[step % 2];
+					struct LabelingWorkspace *workspace = slot->workspace;
+					const double t0 = omp_get_wtime();
+
+					checkLabelingResult(reserveLabels(workspace, slot->src.dimX, slot->src.dimY, slot->src.dimZ));
+					slot->objectCount = checkLabelingResult(blockUnionFindLabelingWith(&slot->src, &workspace->labels, BLOCK_DIM_X, BLOCK_DIM_Y,
+						BLOCK_DIM_Z, connectivity, &workspace->stats, &workspace->tables));
+					labelTime += omp_get_wtime() - t0;
+				}
+			}
+		}
+		if (step >= 0 && step < volumeCount) {
+			totalObjects += slots[step % 2].objectCount;
+		}
+	}
+	printf("Labeled %td volumes with %td objects in %f seconds: I/O took %f seconds and labeling %f seconds.\n",
+		volumeCount, totalObjects, omp_get_wtime() - start, ioTime, labelTime);
+	fclose(fp);
+
+	omp_set_max_active_levels(callerLevels);
+	for (s = 0; s < 2; s++) {
+		if (slots[s].src.data != NULL) freeVolume(&slots[s].src);
+		destroyLabelingWorkspace(slots[s].workspace);
+	}
+	free(inNames);
+	free(outNames);
+	free(text);
+}
+
+/* The number of voxels object current of a frame shares with object
+   previous of the frame before it. */
+struct Overlap {
+	SizeType previous, current, voxels;
+};
+
+struct OverlapTable {
+	SizeType        count, capacity;
+	struct Overlap *overlaps;
+};
+
+/* Append an overlap of voxels voxels of previous and current to the list
+   *overlaps of *count entries, growing it as needed, unless it continues the
+   last entry, which then absorbs it. */
+void appendOverlap(struct Overlap **overlaps, SizeType *count, SizeType *capacity, SizeType previous, SizeType current, SizeType voxels)
+{
+	if (*count > 0 && (*overlaps)[*count - 1].previous == previous && (*overlaps)[*count - 1].current == current) {
+		(*overlaps)[*count - 1].voxels += voxels;
+		return;
+	}
+	if (*count == *capacity) {
+		struct Overlap *grown;
+		*capacity = *capacity > 0 ? 2 * *capacity : 1024;
+		grown = (struct Overlap *)realloc(*overlaps, (size_t)*capacity * sizeof(struct Overlap));
+		if (grown == NULL) {
+			printf("Failed to grow the overlap table to %td entries. \n", *capacity);
+			exit(1);
+		}
+		*overlaps = grown;
+	}
+	(*overlaps)[*count].previous = previous;
+	(*overlaps)[*count].current = current;
+	(*overlaps)[*count].voxels = voxels;
+	(*count)++;
+}
+
+int compareOverlaps(const void *a, const void *b)
+{
+	const struct Overlap *x = (const struct Overlap *)a, *y = (const struct Overlap *)b;
+	if (x->current != y->current) return x->current < y->current ? -1 : 1;
+	return x->previous < y->previous ? -1 : x->previous > y->previous;
+}
+
+/* Fill table with the overlaps of the objects of two consecutive frames,
+   labeled in prevVol and curVol, sorted by current and previous label. Every
+   thread of nThreads gathers the overlaps of its own rows, merging runs of
+   voxels with the same pair of labels as it goes, and the lists of the
+   threads are then sorted and merged. */
+void countLabelOverlaps(const struct Volume *prevVol, const struct Volume *curVol, struct OverlapTable *table, int nThreads)
+{
+	const dstPixelType *prevData = (const dstPixelType *)prevVol->data;
+	const dstPixelType *curData = (const dstPixelType *)curVol->data;
+	const SizeType dimX = curVol->dimX, dimY = curVol->dimY, dimZ = curVol->dimZ;
+	SizeType row, n, merged;
+
+	if (prevVol->dimX != dimX || prevVol->dimY != dimY || prevVol->dimZ != dimZ) {
+		printf("Consecutive frames of %td, %td, %td and %td, %td, %td voxels cannot be matched. \n",
+			prevVol->dimX, prevVol->dimY, prevVol->dimZ, dimX, dimY, dimZ);
+		exit(1);
+	}
+	table->count = 0;
+
+#pragma omp parallel num_threads(nThreads)
+	{
+		struct Overlap *local = NULL;
+		SizeType localCount = 0, localCapacity = 0, i;
+
+#pragma omp for schedule(static)
+		for (row = 0; row < dimY * dimZ; row++) {
+			const dstPixelType *prev = prevData + (row / dimY) * prevVol->strideZ + (row % dimY) * prevVol->strideY;
+			const dstPixelType *cur = curData + (row / dimY) * curVol->strideZ + (row % dimY) * curVol->strideY;
+
+			for (i = 0; i < dimX; i++) {
+				if (prev[i] != 0 && cur[i] != 0) {
+					appendOverlap(&local, &localCount, &localCapacity, (SizeType)prev[i], (SizeType)cur[i], 1);
+				}
+			}
+		}
+#pragma omp critical
+		{
+			if (table->count + localCount > table->capacity) {
+				struct Overlap *grown;
+				table->capacity = table->count + localCount > 2 * table->capacity ? table->count + localCount : 2 * table->capacity;
+				grown = (struct Overlap *)realloc(table->overlaps, (size_t)table->capacity * sizeof(struct Overlap));
+				if (grown == NULL) {
+					printf("Failed to grow the overlap table to %td entries. \n", table->capacity);
+					exit(1);
+				}
+				table->overlaps = grown;
+			}
+			if (localCount > 0) {
+				memcpy(table->overlaps + table->count, local, (size_t)localCount * sizeof(struct Overlap));
+			}
+			table->count += localCount;
+		}
+		free(local);
+	}
 
+	qsort(table->overlaps, (size_t)table->count, sizeof(struct Overlap), compareOverlaps);
+	merged = 0;
+	for (n = 0; n < table->count; n++) {
+		if (merged > 0 && compareOverlaps(&table->overlaps[merged - 1], &table->overlaps[n]) == 0) {
+			table->overlaps[merged - 1].voxels += table->overlaps[n].voxels;
+		}
+		else {
+			table->overlaps[merged++] = table->overlaps[n];
+		}
+	}
+	table->count = merged;
+}
+
+/* The track of every object of a frame, entry n describing the object
+   labeled n + 2, and the track it split off from, 0 if it continues its
+   track or starts a new one. */
+struct FrameTracks {
+	SizeType  objectCount, capacity;
+	SizeType *track, *parent;
+};
+
+/* Give each of the objectCount objects of a frame a track, from the tracks
+   prev of the frame before it and the overlaps of their objects, sorted as by
+   countLabelOverlaps. An object continues the track of the previous object it
+   overlaps most if it is also the object that previous object overlaps most,
+   so when objects merge the merged object continues the track of its largest
+   part, and the tracks of the other parts end. Any other object starts a new
+   track, numbered from *nextTrack on: when it overlaps a previous object it
+   split off from it, and that object's track is its parent. Ties go to the
+   lower label. */
+void assignTracks(const struct OverlapTable *table, const struct FrameTracks *prev, SizeType objectCount, struct FrameTracks *cur,
+	SizeType *nextTrack)
+{
+	const struct Overlap *overlaps = table->overlaps;
+	SizeType *bestCurrent, *bestVoxels;
+	SizeType n, b;
+
+	if (cur->track == NULL || objectCount > cur->capacity) {
+		free(cur->track);
+		free(cur->parent);
+		cur->capacity = objectCount > 0 ? objectCount : 1;
+		cur->track = (SizeType *)malloc((size_t)cur->capacity * sizeof(SizeType));
+		cur->parent = (SizeType *)malloc((size_t)cur->capacity * sizeof(SizeType));
+	}
+	bestCurrent = (SizeType *)malloc((size_t)(prev->objectCount > 0 ? prev->objectCount : 1) * sizeof(SizeType));
+	bestVoxels = (SizeType *)calloc((size_t)(prev->objectCount > 0 ? prev->objectCount : 1), sizeof(SizeType));
+	if (cur->track == NULL || cur->parent == NULL || bestCurrent == NULL || bestVoxels == NULL) {
+		printf("Failed to allocate the tracks of %td objects. \n", objectCount);
+		exit(1);
+	}
+	cur->objectCount = objectCount;
+
+	/* The object of this frame each previous object overlaps most. */
+	for (n = 0; n < table->count; n++) {
+		const SizeType a = overlaps[n].previous - 2;
+		if (overlaps[n].voxels > bestVoxels[a]) {
+			bestVoxels[a] = overlaps[n].voxels;
+			bestCurrent[a] = overlaps[n].current - 2;
+		}
+	}
+
+	n = 0;
+	for (b = 0; b < objectCount; b++) {
+		SizeType best = -1, voxels = 0;
+
+		for (; n < table->count && overlaps[n].current - 2 == b; n++) {
+			if (overlaps[n].voxels > voxels) {
+				voxels = overlaps[n].voxels;
+				best = overlaps[n].previous - 2;
+			}
+		}
+		if (best >= 0 && bestCurrent[best] == b) {
+			cur->track[b] = prev->track[best];
+			cur->parent[b] = 0;
+		}
+		else {
+			cur->track[b] = (*nextTrack)++;
+			cur->parent[b] = best >= 0 ? prev->track[best] : 0;
+		}
+	}
+	free(bestCurrent);
+	free(bestVoxels);
+}
+
+/* Label a time series of frames, the volume files of a batch list, see
+   readBatchList, as one 4-D image in which an object of a frame is linked to
+   the objects it overlaps in the frame before it, and follow the objects as
+   tracks through time, see assignTracks. The table tableName gets a line per
+   object of every frame with its track, parent track, size and centroid; the
+   labels of a frame are written to its label file, if the list names one.
+   Frames are labeled with the block engine into three workspaces, so that
+   while frame t is labeled, the labels of frames t - 1 and t - 2 are still
+   in memory. One section, on about a quarter of the threads, then counts
+   the overlaps of frames t - 1 and t - 2, assigns the tracks of frame t - 1,
+   writes its table lines and labels and reads frame t + 1, as runBatch
+   does; the other section labels frame t on the remaining threads. */
+void runTracking(const char *listName, const char *tableName, int connectivity)
+{
+	struct LabelingWorkspace *workspaces[3];
+	struct Volume sources[2];
+	size_t sourceCapacities[2];
+	struct FrameTracks tracks[2];
+	struct OverlapTable table;
+	SizeType objectCounts[3];
+	char *text, **inNames, **outNames;
+	SizeType frameCount, nextTrack = 1, t;
+	double matchTime = 0.0, labelTime = 0.0, start;
+	const int matchThreads = (omp_get_max_threads() + 3) / 4;
+	const int labelThreads = omp_get_max_threads() > matchThreads ? omp_get_max_threads() - matchThreads : 1;
+	int callerLevels, s;
+	FILE *fp;
+
+	frameCount = readBatchList(listName, &text, &inNames, &outNames);
+	fp = fopen(tableName, "w");
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", tableName);
+		exit(1);
+	}
+	fprintf(fp, "frame,label,track,parent,voxels,iCentroid,jCentroid,kCentroid\n");
+	memset(tracks, 0, sizeof(tracks));
+	memset(&table, 0, sizeof(table));
+	memset(sources, 0, sizeof(sources));
+	for (s = 0; s < 3; s++) {
+		workspaces[s] = createLabelingWorkspace();
+		if (workspaces[s] == NULL) checkLabelingResult(LABELING_ERROR_MEMORY);
+		objectCounts[s] = 0;
+	}
+	sourceCapacities[0] = sourceCapacities[1] = 0;
+
+	/* As in runBatch, the labeling and the matching run their parallel
+	   regions inside a section. */
+	callerLevels = omp_get_max_active_levels();
+	if (callerLevels < 2) omp_set_max_active_levels(2);
+
+	start = omp_get_wtime();
+	for (t = -1; t <= frameCount; t++) {
+#pragma omp parallel sections num_threads(2)
+		{
+#pragma omp section
+			{
+				/* Match frame t - 1, labeled in the last step, with frame
+				   t - 2, which the labeling of frame t leaves alone, and
+				   assign its tracks. Frames t - 1 and t + 1 share a source,
+				   so frame t + 1 is read last. */
+				const double t0 = omp_get_wtime();
+
+				if (t >= 1) {
+					struct LabelingWorkspace *workspace = workspaces[(t - 1) % 3];
+					const struct ObjectStats *stats = &workspace->stats;
+					SizeType n;
+
+					if (t >= 2) {
+						countLabelOverlaps(&workspaces[(t - 2) % 3]->labels, &workspace->labels, &table, matchThreads);
+					}
+					else {
+						table.count = 0;
+					}
+					assignTracks(&table, &tracks[t % 2], objectCounts[(t - 1) % 3], &tracks[(t - 1) % 2], &nextTrack);
+					for (n = 0; n < stats->objectCount; n++) {
+						fprintf(fp, "%td,%td,%td,%td,%td,%.3f,%.3f,%.3f\n", t - 1, n + 2, tracks[(t - 1) % 2].track[n],
+							tracks[(t - 1) % 2].parent[n], stats->voxelCount[n], stats->iCentroid[n], stats->jCentroid[n], stats->kCentroid[n]);
+					}
+					if (outNames[t - 1] != NULL) {
+						writeVolumeFile(outNames[t - 1], &workspace->labels);
+					}
+				}
+				if (t + 1 < frameCount) {
+					readVolumeFile(inNames[t + 1], &sources[(t + 1) % 2], &sourceCapacities[(t + 1) % 2], sizeof(srcPixelType));
+				}
+				matchTime += omp_get_wtime() - t0;
+			}
+#pragma omp section
+			{
+				/* Label frame t over the labels of frame t - 3. */
+				if (t >= 0 && t < frameCount) {
+					struct LabelingWorkspace *workspace = workspaces[t % 3];
+					const struct Volume *srcVol = &sources[t % 2];
+					const double t0 = omp_get_wtime();
+
+					omp_set_num_threads(labelThreads);
+					checkLabelingResult(reserveLabels(workspace, srcVol->dimX, srcVol->dimY, srcVol->dimZ));
+					objectCounts[t % 3] = checkLabelingResult(blockUnionFindLabelingWith(srcVol, &workspace->labels, BLOCK_DIM_X, BLOCK_DIM_Y,
+						BLOCK_DIM_Z, connectivity, &workspace->stats, &workspace->tables));
+					labelTime += omp_get_wtime() - t0;
+				}
+			}
+		}
+	}
+	fclose(fp);
+	printf("Tracked %td objects through %td frames in %f seconds: labeling took %f seconds, and matching and I/O %f seconds.\n",
+		nextTrack - 1, frameCount, omp_get_wtime() - start, labelTime, matchTime);
+
+	omp_set_max_active_levels(callerLevels);
+	for (s = 0; s < 3; s++) {
+		destroyLabelingWorkspace(workspaces[s]);
+	}
+	for (s = 0; s < 2; s++) {
+		if (sources[s].data != NULL) freeVolume(&sources[s]);
+		free(tracks[s].track);
+		free(tracks[s].parent);
+	}
+	free(table.overlaps);
+	free(inNames);
+	free(outNames);
+	free(text);
+}
+
+/* Check the statistics of the objects of labelVol, as gathered into stats
+   by the engine called name, against refStats, those of the objects of
+   refVol, a labeling of the same image. The objects of both are matched by
+   their voxels, so they may be numbered differently; the centroids may
+   differ by tolerance. Call this before compareLabelings, which renumbers
+   the labels. Return 1 if the statistics agree. */
+int compareObjectStats(const struct Volume *labelVol, const struct ObjectStats *stats, const struct Volume *refVol,
+	const struct ObjectStats *refStats, const char *name, double tolerance)
+{
+	const dstPixelType *labels = (const dstPixelType *)labelVol->data, *refLabels = (const dstPixelType *)refVol->data;
+	const SizeType voxels = labelVol->dimX * labelVol->dimY * labelVol->dimZ;
+	SizeType *refObject, x, n;
+	int agree = 1;
+
+	if (stats->objectCount != refStats->objectCount) {
+		printf("%s: statistics of %td objects, not %td\n", name, stats->objectCount, refStats->objectCount);
+		return 0;
+	}
+	refObject = (SizeType *)malloc((size_t)(stats->objectCount > 0 ? stats->objectCount : 1) * sizeof(SizeType));
+	if (refObject == NULL) {
+		printf("Failed to allocate the object map of the statistics check. \n");
+		exit(1);
+	}
+	for (n = 0; n < stats->objectCount; n++) refObject[n] = -1;
+	for (x = 0; x < voxels; x++) {
+		if (labels[x] >= 2 && (SizeType)labels[x] - 2 < stats->objectCount && refLabels[x] >= 2) {
+			refObject[labels[x] - 2] = (SizeType)refLabels[x] - 2;
+		}
+	}
+
+	for (n = 0; n < stats->objectCount && agree; n++) {
+		const SizeType r = refObject[n];
+		const double di = r < 0 ? 0.0 : stats->iCentroid[n] - refStats->iCentroid[r];
+		const double dj = r < 0 ? 0.0 : stats->jCentroid[n] - refStats->jCentroid[r];
+		const double dk = r < 0 ? 0.0 : stats->kCentroid[n] - refStats->kCentroid[r];
+
+		if (r < 0 || r >= refStats->objectCount) {
+			printf("%s: object %td has no voxels\n", name, n + 2);
+			agree = 0;
+		}
+		else if (stats->voxelCount[n] != refStats->voxelCount[r] || stats->iMin[n] != refStats->iMin[r] || stats->iMax[n] != refStats->iMax[r] ||
+			stats->jMin[n] != refStats->jMin[r] || stats->jMax[n] != refStats->jMax[r] || stats->kMin[n] != refStats->kMin[r] ||
+			stats->kMax[n] != refStats->kMax[r] || di > tolerance || di < -tolerance || dj > tolerance || dj < -tolerance ||
+			dk > tolerance || dk < -tolerance) {
+			printf("%s: object %td has %td voxels in [%td, %td] x [%td, %td] x [%td, %td] around (%.3f, %.3f, %.3f),\n"
+				"  not %td voxels in [%td, %td] x [%td, %td] x [%td, %td] around (%.3f, %.3f, %.3f)\n", name, n + 2,
+				stats->voxelCount[n], stats->iMin[n], stats->iMax[n], stats->jMin[n], stats->jMax[n], stats->kMin[n], stats->kMax[n],
+				stats->iCentroid[n], stats->jCentroid[n], stats->kCentroid[n],
+				refStats->voxelCount[r], refStats->iMin[r], refStats->iMax[r], refStats->jMin[r], refStats->jMax[r], refStats->kMin[r],
+				refStats->kMax[r], refStats->iCentroid[r], refStats->jCentroid[r], refStats->kCentroid[r]);
+			agree = 0;
+		}
+	}
+	free(refObject);
+	return agree;
+}
+
+/* Check the library interface of Parallel_Labeling.h on byteVol, an
+   unpacked image, against its canonical labeling by reference in refVol,
+   whose statistics are refStats: the labels of labelImage, the labels and
+   statistics of labelImageStats, both in the same workspace, the labels of
+   relabelImage after a run of voxels is toggled, which byteVol gets back
+   afterwards, and that invalid calls return LABELING_ERROR_ARGUMENT. dstVol
+   is scratch. Return the number of checks that fail. */
+int checkLibrary(struct Volume *byteVol, struct Volume *refVol, const struct ObjectStats *refStats, struct Volume *dstVol,
+	const struct NamedEngine *reference, int connectivity)
+{
+	srcPixelType *srcData = (srcPixelType *)byteVol->data;
+	const SizeType dimX = byteVol->dimX, dimY = byteVol->dimY, dimZ = byteVol->dimZ, voxels = dimX * dimY * dimZ;
+	const SizeType runLength = dimX < 16 ? dimX : 16, runStart = voxels / 2 / dimX * dimX;
+	struct LabelingWorkspace *workspace = createLabelingWorkspace();
+	const struct ObjectStats *stats;
+	const struct LabelChanges *changes;
+	const dstPixelType *labels;
+	struct Volume copyVol;
+	SizeType changed[17] = { 0 }, objectCount, x;
+	int failures = 0, call;
+
+	if (workspace == NULL) checkLabelingResult(LABELING_ERROR_MEMORY);
+	if (relabelImage(workspace, srcData, changed, 0, &labels, &changes) != LABELING_ERROR_ARGUMENT ||
+		labelImage(workspace, srcData, dimX, dimY, dimZ, 5, &labels) != LABELING_ERROR_ARGUMENT ||
+		labelImage(workspace, srcData, -1, dimY, dimZ, connectivity, &labels) != LABELING_ERROR_ARGUMENT) {
+		printf("library: invalid calls do not return LABELING_ERROR_ARGUMENT\n");
+		failures++;
+	}
+
+	for (call = 0; call < 2; call++) {
+		const char *name = call == 0 ? "labelImage" : "labelImageStats";
+
+		objectCount = checkLabelingResult(call == 0 ? labelImage(workspace, srcData, dimX, dimY, dimZ, connectivity, &labels)
+			: labelImageStats(workspace, srcData, dimX, dimY, dimZ, connectivity, &labels, &stats));
+		memcpy(dstVol->data, labels, (size_t)voxels * sizeof(dstPixelType));
+		if (objectCount != refStats->objectCount) {
+			printf("%s: finds %td objects, not %td\n", name, objectCount, refStats->objectCount);
+			failures++;
+		}
+		else if (call == 1 && !compareObjectStats(dstVol, stats, refVol, refStats, name, 1e-6)) {
+			failures++;
+		}
+		else if (compareLabelings(refVol, dstVol, reference->name, name)) {
+			printf("%s: agrees with %s\n", name, reference->name);
+		}
+		else {
+			failures++;
+		}
+	}
+
+	for (x = 0; x < runLength; x++) {
+		changed[x] = runStart + x;
+		srcData[changed[x]] = (srcPixelType)!srcData[changed[x]];
+	}
+	changed[runLength] = voxels;
+	if (relabelImage(workspace, srcData, changed, runLength + 1, &labels, &changes) != LABELING_ERROR_ARGUMENT) {
+		printf("relabelImage: accepts a voxel outside the image\n");
+		failures++;
+	}
+	checkLabelingResult(relabelImage(workspace, srcData, changed, runLength, &labels, &changes));
+	allocateVolume(&copyVol, dimX, dimY, dimZ, sizeof(dstPixelType));
+	memcpy(copyVol.data, labels, (size_t)voxels * sizeof(dstPixelType));
+	reference->engine(byteVol, dstVol, connectivity, NULL);
+	if (compareLabelings(dstVol, &copyVol, reference->name, "relabelImage")) {
+		printf("relabelImage: agrees with %s\n", reference->name);
+	}
+	else {
+		failures++;
+	}
+	for (x = 0; x < runLength; x++) {
+		srcData[changed[x]] = (srcPixelType)!srcData[changed[x]];
+	}
+
+	freeVolume(&copyVol);
+	destroyLabelingWorkspace(workspace);
+	return failures;
+}
+
+/* Check runBatch on three volumes: the image in scratchName, a bit-packed
+   copy of it, bitVol, and the image once more, so that both buffers are
+   used again. The labels and the statistics table of each volume are
+   compared with refVol, the canonical labeling of the image by reference,
+   and refStats, its statistics, see compareObjectStats. The files of the
+   batch are removed afterwards. Return the number of volumes that
+   disagree. */
+int checkBatch(const char *scratchName, const struct Volume *bitVol, struct Volume *refVol, const struct ObjectStats *refStats,
+	const struct NamedEngine *reference, int connectivity)
+{
+	const size_t nameLength = strlen(scratchName) + 16;
+	char *packedName = (char *)malloc(nameLength), *listName = (char *)malloc(nameLength), *statsName = (char *)malloc(nameLength);
+	char *labelNames[3];
+	struct ObjectStats stats[3];
+	SizeType volume, label, voxelCount, iMin, iMax, jMin, jMax, kMin, kMax;
+	double iCentroid, jCentroid, kCentroid;
+	int failures = 0, v;
+	FILE *fp;
+
+	for (v = 0; v < 3; v++) {
+		labelNames[v] = (char *)malloc(nameLength);
+		allocateObjectStats(&stats[v], 64);
+	}
+	if (packedName == NULL || listName == NULL || statsName == NULL || labelNames[0] == NULL || labelNames[1] == NULL ||
+		labelNames[2] == NULL) {
+		printf("Failed to allocate a file name. \n");
+		exit(1);
+	}
+	sprintf(packedName, "%s.packed", scratchName);
+	sprintf(listName, "%s.list", scratchName);
+	sprintf(statsName, "%s.csv", scratchName);
+	writeVolumeFile(packedName, bitVol);
+	fp = fopen(listName, "w");
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", listName);
+		exit(1);
+	}
+	for (v = 0; v < 3; v++) {
+		sprintf(labelNames[v], "%s.batch%d", scratchName, v);
+		fprintf(fp, "%s %s\n", v == 1 ? packedName : scratchName, labelNames[v]);
+	}
+	fclose(fp);
+
+	runBatch(listName, statsName, connectivity);
+
+	/* Read back the statistics table, whose lines list the objects of every
+	   volume in label order. */
+	fp = fopen(statsName, "r");
+	if (fp == NULL || fscanf(fp, "%*[^\n]\n") != 0) {
+		printf("Failed to read %s. \n", statsName);
+		exit(1);
+	}
+	while (fscanf(fp, "%td,%td,%td,%td,%td,%td,%td,%td,%td,%lf,%lf,%lf\n", &volume, &label, &voxelCount, &iMin, &iMax, &jMin, &jMax,
+		&kMin, &kMax, &iCentroid, &jCentroid, &kCentroid) == 12) {
+		struct ObjectStats *s;
+		SizeType n;
+
+		if (volume < 0 || volume >= 3 || label != stats[volume].objectCount + 2) {
+			printf("batch: %s lists object %td of volume %td out of order\n", statsName, label, volume);
+			failures++;
+			break;
+		}
+		s = &stats[volume];
+		n = s->objectCount++;
+		if (n == s->capacity) growObjectStats(s, 2 * s->capacity);
+		s->voxelCount[n] = voxelCount;
+		s->iMin[n] = iMin;
+		s->iMax[n] = iMax;
+		s->jMin[n] = jMin;
+		s->jMax[n] = jMax;
+		s->kMin[n] = kMin;
+		s->kMax[n] = kMax;
+		s->iCentroid[n] = iCentroid;
+		s->jCentroid[n] = jCentroid;
+		s->kCentroid[n] = kCentroid;
+	}
+	fclose(fp);
+
+	for (v = 0; v < 3 && failures == 0; v++) {
+		struct Volume labelVol;
+		char name[32];
+
+		sprintf(name, "batch volume %d", v);
+		mapVolumeFile(labelNames[v], &labelVol, sizeof(dstPixelType));
+		/* The table rounds the centroids to three decimals. */
+		if (!compareObjectStats(&labelVol, &stats[v], refVol, refStats, name, 0.001)) {
+			failures++;
+		}
+		else if (compareLabelings(refVol, &labelVol, reference->name, name)) {
+			printf("%s: agrees with %s\n", name, reference->name);
+		}
+		else {
+			failures++;
+		}
+		freeVolume(&labelVol);
+	}
+
+	remove(packedName);
+	remove(listName);
+	remove(statsName);
+	for (v = 0; v < 3; v++) {
+		remove(labelNames[v]);
+		free(labelNames[v]);
+		freeObjectStats(&stats[v]);
+	}
+	free(packedName);
+	free(listName);
+	free(statsName);
+	return failures;
+}
+
+/* The objects of the frames of checkTracking, as boxes { iMin, iMax, jMin,
+   jMax }, the maxima excluded, through planes 1 up to 4 of a volume of
+   80 * 20 * 6 voxels. Object A, at the top left, splits in frame 1 into a
+   larger part A, which keeps its place, and a part A2 at the right; in
+   frame 2 part A merges with object B, below it, through the last box. The
+   list of a frame ends with an empty box. */
+static const SizeType trackingBoxes[3][5][4] = {
+	{ { 2, 50, 2, 10 }, { 2, 12, 12, 18 } },
+	{ { 2, 36, 2, 10 }, { 38, 50, 2, 10 }, { 2, 12, 12, 18 } },
+	{ { 2, 36, 2, 10 }, { 38, 50, 2, 10 }, { 2, 12, 12, 18 }, { 2, 6, 10, 12 } }
+};
+
+/* A voxel of A, A2 and B in plane 2 of the frames of checkTracking. */
+static const SizeType trackingProbes[3][2] = { { 3, 3 }, { 40, 3 }, { 3, 14 } };
+
+/* Check runTracking on the frames of trackingBoxes, written next to
+   scratchName, against the tracks they should get: A and B start tracks of
+   their own; in frame 1 A continues its track, and A2 starts a new one whose
+   parent is that of A; in frame 2 the merged object continues the track of
+   A, the larger part, and A2 its own. The files are removed afterwards.
+   Return 1 if the tracks disagree, and 0 otherwise. */
+int checkTracking(const char *scratchName, int connectivity)
+{
+	const SizeType dimX = 80, dimY = 20, dimZ = 6;
+	const size_t nameLength = strlen(scratchName) + 16;
+	char *listName = (char *)malloc(nameLength), *tableName = (char *)malloc(nameLength);
+	char *frameNames[3], *labelNames[3];
+	SizeType track[3][8], parent[3][8], probe[3][3];
+	SizeType frame, label, trackNo, parentNo, i, j, k;
+	struct Volume frameVol;
+	int failed, f, b, n;
+	FILE *fp;
+
+	for (f = 0; f < 3; f++) {
+		frameNames[f] = (char *)malloc(nameLength);
+		labelNames[f] = (char *)malloc(nameLength);
+		if (frameNames[f] == NULL || labelNames[f] == NULL) {
+			printf("Failed to allocate a file name. \n");
+			exit(1);
+		}
+	}
+	if (listName == NULL || tableName == NULL) {
+		printf("Failed to allocate a file name. \n");
+		exit(1);
+	}
+	sprintf(listName, "%s.frames", scratchName);
+	sprintf(tableName, "%s.tracks", scratchName);
+	fp = fopen(listName, "w");
+	if (fp == NULL) {
+		printf("Failed to open %s for writing. \n", listName);
+		exit(1);
+	}
+	allocateVolume(&frameVol, dimX, dimY, dimZ, sizeof(srcPixelType));
+	for (f = 0; f < 3; f++) {
+		memset(frameVol.data, 0, (size_t)(dimX * dimY * dimZ) * sizeof(srcPixelType));
+		for (b = 0; b < 5 && trackingBoxes[f][b][1] > 0; b++) {
+			for (k = 1; k < dimZ - 1; k++) {
+				for (j = trackingBoxes[f][b][2]; j < trackingBoxes[f][b][3]; j++) {
+					for (i = trackingBoxes[f][b][0]; i < trackingBoxes[f][b][1]; i++) {
+						((srcPixelType *)frameVol.data)[(k * dimY + j) * dimX + i] = 1;
+					}
+				}
+			}
+		}
+		sprintf(frameNames[f], "%s.frame%d", scratchName, f);
+		sprintf(labelNames[f], "%s.labels%d", scratchName, f);
+		writeVolumeFile(frameNames[f], &frameVol);
+		fprintf(fp, "%s %s\n", frameNames[f], labelNames[f]);
+	}
+	fclose(fp);
+	freeVolume(&frameVol);
+
+	runTracking(listName, tableName, connectivity);
+
+	/* Look up the labels of the probes, and the tracks of the labels. */
+	for (f = 0; f < 3; f++) {
+		struct Volume labelVol;
+
+		mapVolumeFile(labelNames[f], &labelVol, sizeof(dstPixelType));
+		for (n = 0; n < 3; n++) {
+			label = (SizeType)((const dstPixelType *)labelVol.data)[(2 * dimY + trackingProbes[n][1]) * dimX + trackingProbes[n][0]];
+			probe[f][n] = label >= 2 && label < 8 ? label : 0;
+		}
+		freeVolume(&labelVol);
+		for (n = 0; n < 8; n++) track[f][n] = parent[f][n] = -1;
+	}
+	fp = fopen(tableName, "r");
+	if (fp == NULL || fscanf(fp, "%*[^\n]\n") != 0) {
+		printf("Failed to read %s. \n", tableName);
+		exit(1);
+	}
+	while (fscanf(fp, "%td,%td,%td,%td,%*[^\n]\n", &frame, &label, &trackNo, &parentNo) == 4) {
+		if (frame >= 0 && frame < 3 && label >= 2 && label < 8) {
+			track[frame][label] = trackNo;
+			parent[frame][label] = parentNo;
+		}
+	}
+	fclose(fp);
+
+#define TRACK(f, n) track[f][probe[f][n]]
+#define PARENT(f, n) parent[f][probe[f][n]]
+	failed = !(TRACK(0, 0) > 0 && TRACK(0, 2) > 0 && TRACK(0, 0) != TRACK(0, 2) && PARENT(0, 0) == 0 && PARENT(0, 2) == 0 &&
+		TRACK(1, 0) == TRACK(0, 0) && PARENT(1, 0) == 0 && TRACK(1, 2) == TRACK(0, 2) && PARENT(1, 2) == 0 &&
+		TRACK(1, 1) > 0 && TRACK(1, 1) != TRACK(0, 0) && TRACK(1, 1) != TRACK(0, 2) && PARENT(1, 1) == TRACK(0, 0) &&
+		probe[2][0] == probe[2][2] && TRACK(2, 0) == TRACK(0, 0) && PARENT(2, 0) == 0 && TRACK(2, 1) == TRACK(1, 1) && PARENT(2, 1) == 0);
+	if (failed) {
+		for (f = 0; f < 3; f++) {
+			for (n = 0; n < 3; n++) {
+				if (f == 0 && n == 1) continue;
+				printf("tracking: frame %d, %s has label %td, track %td, parent %td\n", f, n == 0 ? "A" : n == 1 ? "A2" : "B", probe[f][n],
+					TRACK(f, n), PARENT(f, n));
+			}
+		}
+	}
+	else {
+		printf("tracking: follows a split and a merge\n");
+	}
+#undef TRACK
+#undef PARENT
+
+	remove(listName);
+	remove(tableName);
+	for (f = 0; f < 3; f++) {
+		remove(frameNames[f]);
+		remove(labelNames[f]);
+		free(frameNames[f]);
+		free(labelNames[f]);
+	}
+	free(listName);
+	free(tableName);
+	return failed;
+}
+
+/* Check labeling engines against each other on one image:
+
+     Parallel_Labeling [--connectivity C] --check [engine [engine]] [--scratch file] [image]
+
+   With two engines of labelingEngines, they are compared; with one, it is
+   compared with single-pass; without any, every engine is. The image is
+   chosen as for runBenchmark. Every engine is checked twice, reading the
+   image unpacked and bit-packed. Without engines the neighbor counts are
+   checked too, see checkNeighborCounts, the library interface, see
+   checkLibrary, and incremental relabeling, see checkRelabeling. With
+   --scratch streamLabeling is checked on a copy of the image written to
+   file, with the labels in file.labels, and without engines also
+   streamProcess, the batch pipeline, see checkBatch, and the tracking of
+   objects, see checkTracking. Return the number of checks that fail. */
+int runDifferentialCheck(int argc, char *argv[], int connectivity)
+{
+	struct ImageSource source;
+	struct Volume srcVol, dstVol, refVol;
+	struct Volume byteVol, bitVol;
+	const struct NamedEngine *reference = findEngine("single-pass"), *engines[ENGINE_COUNT];
+	const char *image, *scratchName = NULL;
+	struct ObjectStats refStats;
+	SizeType refCount;
+	int engineCount = 0, failures = 0, allEngines, a, e, packed;
+
+	initImageSource(&source);
+	for (a = 0; a < argc; a++) {
+		const struct NamedEngine *engine = findEngine(argv[a]);
+
+		if (engine != NULL && engineCount < 2) engines[engineCount++] = engine;
+		else if (a + 1 < argc && strcmp(argv[a], "--scratch") == 0) scratchName = argv[++a];
+		else if (!parseImageSourceOption(argc, argv, &a, &source)) {
+			printf("Unknown check option %s.\n", argv[a]);
+			exit(1);
+		}
+	}
+	if (engineCount == 2) {
+		reference = engines[0];
+		engines[0] = engines[1];
+		engineCount = 1;
+	}
+	allEngines = engineCount == 0;
+	if (allEngines) {
+		for (e = 0; e < ENGINE_COUNT; e++) {
+			if (&labelingEngines[e] != reference) engines[engineCount++] = &labelingEngines[e];
+		}
+	}
+
+	image = loadImageSource(&source, &srcVol, &dstVol);
+	allocateVolume(&refVol, srcVol.dimX, srcVol.dimY, srcVol.dimZ, sizeof(dstPixelType));
+	printf("Checking %s, dims %td, %td, %td, connectivity %d, %d threads\n", image, srcVol.dimX, srcVol.dimY, srcVol.dimZ,
+		connectivity, omp_get_max_threads());
+
+	reportObjectCounts = 0;
+	copyWithBothPackings(&srcVol, &byteVol, &bitVol);
+	reference->engine(&byteVol, &refVol, connectivity, NULL);
+	refCount = canonicalizeLabels(&refVol);
+	printf("%s: %td objects\n", reference->name, refCount);
+	for (packed = 0; packed < 2; packed++) {
+		for (e = 0; e < engineCount; e++) {
+			char name[64];
+
+			sprintf(name, "%s%s", engines[e]->name, packed ? " packed" : "");
+			engines[e]->engine(packed ? &bitVol : &byteVol, &dstVol, connectivity, NULL);
+			if (compareLabelings(&refVol, &dstVol, reference->name, name)) {
+				printf("%s: agrees with %s\n", name, reference->name);
+			}
+			else {
+				failures++;
+			}
+		}
+	}
+
+	if (scratchName != NULL) {
+		char *labelsName = (char *)malloc(strlen(scratchName) + sizeof(".labels"));
+		struct Volume streamVol;
+		SizeType objectCount, x;
+
+		if (labelsName == NULL) {
+			printf("Failed to allocate a file name. \n");
+			exit(1);
+		}
+		sprintf(labelsName, "%s.labels", scratchName);
+		writeVolumeFile(scratchName, &byteVol);
+		objectCount = streamLabeling(scratchName, 0, 0, 0, labelsName, connectivity);
+		mapVolumeFile(labelsName, &streamVol, labelSizeFor(objectCount));
+		for (x = 0; x < srcVol.dimX * srcVol.dimY * srcVol.dimZ; x++) {
+			const char *label = (const char *)streamVol.data + x * streamVol.elemSize;
+			((dstPixelType *)dstVol.data)[x] = (dstPixelType)(streamVol.elemSize == sizeof(uint16_t) ? *(const uint16_t *)label
+				: streamVol.elemSize == sizeof(uint32_t) ? *(const uint32_t *)label : *(const uint64_t *)label);
+		}
+		freeVolume(&streamVol);
+		if (compareLabelings(&refVol, &dstVol, reference->name, "stream")) {
+			printf("stream: agrees with %s\n", reference->name);
+		}
+		else {
+			failures++;
+		}
+		free(labelsName);
+	}
+	if (allEngines) {
+		failures += checkNeighborCounts(&byteVol, &bitVol, scratchName, connectivity);
+		labelStats(&refVol, refCount, &refStats);
+		failures += checkLibrary(&byteVol, &refVol, &refStats, &dstVol, reference, connectivity);
+		if (scratchName != NULL) {
+			failures += checkBatch(scratchName, &bitVol, &refVol, &refStats, reference, connectivity);
+			failures += checkTracking(scratchName, connectivity);
+		}
+		freeObjectStats(&refStats);
+		failures += checkRelabeling(&byteVol, &dstVol, &refVol, reference, connectivity);
+	}
+	reportObjectCounts = 1;
+
+	freeVolume(&byteVol);
+	freeVolume(&bitVol);
+	freeVolume(&refVol);
+	freeImages(&srcVol, &dstVol);
+	return failures;
+}
+
+#ifndef PARALLEL_LABELING_LIBRARY
+/* Usage:
+     Parallel_Labeling                   label the ascii image FNAME
+     Parallel_Labeling volume.vol        label a binary volume file
+     Parallel_Labeling --convert image.txt dimX dimY dimZ volume.vol
+                                         convert an ascii image once
+     Parallel_Labeling --convert-packed image.txt dimX dimY dimZ volume.vol
+                                         same, into a bit-packed volume
+     Parallel_Labeling --stream-count volume.vol [counts.vol]
+     Parallel_Labeling --stream-count image.txt dimX dimY dimZ [counts.vol]
+                                         neighbor count histogram of a volume
+                                         of any depth, three planes at a time
+     Parallel_Labeling --stream-label volume.vol [labels.vol]
+     Parallel_Labeling --stream-label image.txt dimX dimY dimZ [labels.vol]
+                                         label a volume of any depth, two
+                                         planes at a time
+     Parallel_Labeling --generate pattern dimX dimY dimZ seed volume.vol [density [size]]
+     Parallel_Labeling --generate-packed pattern dimX dimY dimZ seed volume.vol [density [size]]
+                                         write a synthetic volume of any size,
+                                         see struct Generator for the patterns
+     Parallel_Labeling --batch list.txt stats.csv
+                                         label many volume files, reading
+                                         the next and writing the last while
+                                         one is labeled, see runBatch
+     Parallel_Labeling --track list.txt tracks.csv
+                                         label the frames of a time series
+                                         and follow their objects through
+                                         time, see runTracking
+     Parallel_Labeling --bench [options] [volume.vol]
+                                         time the labeling engines over
+                                         repeated trials and thread counts,
+                                         see runBenchmark
+     Parallel_Labeling --check [engine [engine]] [options] [volume.vol]
+                                         check that labeling engines find the
+                                         same objects, see runDifferentialCheck;
+                                         checkAll.sh runs it over every pattern,
+                                         connectivity and LABEL_BITS
+     Parallel_Labeling --connectivity 6|18|26 ...
+                                         any of the above with voxels
+                                         touching at faces (the default),
+                                         also at edges, or also at corners
+     Parallel_Labeling [--connectivity C] --numa ...
+                                         any of the above with every slab of
+                                         the volumes first touched by the
+                                         thread that labels it, and a report
+                                         of the page placement */
+int main(int argc, char *argv[])
+{
+	struct Volume   srcVol;
+	struct Volume   dstVol;
+	struct Volume   labelVol;
+	struct ObjectStats stats;
+	int             connectivity = 6;
+
+	if (argc >= 3 && strcmp(argv[1], "--connectivity") == 0) {
+		connectivity = atoi(argv[2]);
+		checkConnectivity(connectivity);
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc >= 2 && strcmp(argv[1], "--numa") == 0) {
+		numaFirstTouch = 1;
+		argc -= 1;
+		argv += 1;
+	}
+
+	if (argc == 7 && (strcmp(argv[1], "--convert") == 0 || strcmp(argv[1], "--convert-packed") == 0)) {
+		convertAsciiToVolumeFile(argv[2], (SizeType)atoll(argv[3]), (SizeType)atoll(argv[4]),
+			(SizeType)atoll(argv[5]), strcmp(argv[1], "--convert-packed") == 0 ? VOLUME_PACKING_BITS : VOLUME_PACKING_NONE,
+			argv[6]);
+		return 0;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "--stream-count") == 0) {
+		SizeType sums[MAX_NEIGHBORS + 1];
+
+		if (argc <= 4) {
+			streamProcess(argv[2], 0, 0, 0, argc == 4 ? argv[3] : NULL, connectivity, sums);
+		}
+		else {
+			streamProcess(argv[2], (SizeType)atoll(argv[3]), (SizeType)atoll(argv[4]), (SizeType)atoll(argv[5]),
+				argc == 7 ? argv[6] : NULL, connectivity, sums);
+		}
+		printNeighborHistogram(sums, connectivity);
+		return 0;
+	}
+
+	if ((argc == 8 || argc == 9 || argc == 10) && (strcmp(argv[1], "--generate") == 0 || strcmp(argv[1], "--generate-packed") == 0)) {
+		struct Generator gen;
+
+		initGenerator(&gen, argv[2], (uint64_t)strtoull(argv[6], NULL, 10), argc >= 9 ? atof(argv[8]) : GENERATOR_DENSITY,
+			argc == 10 ? (SizeType)atoll(argv[9]) : GENERATOR_SIZE, (SizeType)atoll(argv[3]), (SizeType)atoll(argv[4]), (SizeType)atoll(argv[5]));
+		generateVolumeFile(&gen, strcmp(argv[1], "--generate-packed") == 0 ? VOLUME_PACKING_BITS : VOLUME_PACKING_NONE, argv[7]);
+		freeGenerator(&gen);
+		printf("Generated %s.\n", argv[7]);
+		return 0;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "--check") == 0) {
+		return runDifferentialCheck(argc - 2, argv + 2, connectivity) == 0 ? 0 : 1;
+	}
+
+	if (argc == 4 && strcmp(argv[1], "--batch") == 0) {
+		runBatch(argv[2], argv[3], connectivity);
+		return 0;
+	}
+
+	if (argc == 4 && strcmp(argv[1], "--track") == 0) {
+		runTracking(argv[2], argv[3], connectivity);
+		return 0;
+	}
+
+	if (argc >= 2 && strcmp(argv[1], "--bench") == 0) {
+		runBenchmark(argc - 2, argv + 2, connectivity);
+		return 0;
+	}
+
+	if (argc >= 3 && strcmp(argv[1], "--stream-label") == 0) {
+		if (argc <= 4) {
+			streamLabeling(argv[2], 0, 0, 0, argc == 4 ? argv[3] : NULL, connectivity);
+		}
+		else {
+			streamLabeling(argv[2], (SizeType)atoll(argv[3]), (SizeType)atoll(argv[4]), (SizeType)atoll(argv[5]),
+				argc == 7 ? argv[6] : NULL, connectivity);
+		}
+		return 0;
+	}
+
+	if (argc == 2) {
+		/* Map the source image, and allocate a destination image of the
+		   same size. */
+		mapVolumeFile(argv[1], &srcVol, sizeof(srcPixelType));
+		allocateZeroedVolume(&dstVol, srcVol.dimX, srcVol.dimY, srcVol.dimZ, sizeof(dstPixelType));
+	}
+	else {
+		/* Allocate memory for source and destination images. Each image is
+		   a single contiguous block of memory. */
+		allocateImages(&srcVol, &dstVol);
+
+		/* Read the source image. */
+		readSrcImg(&srcVol);
+	}
+
+	printf("Dims: %td, %td, %td\n", srcVol.dimX, srcVol.dimY, srcVol.dimZ);
+	printf("Volume: %td\n", srcVol.dimX * srcVol.dimY * srcVol.dimZ);
+	if (numaFirstTouch) {
+		reportPagePlacement(&srcVol, "the source image");
+		reportPagePlacement(&dstVol, "the destination image");
+	}
+
+	double start, end;
 	/*Start clocking*/
-	start = clock();
+	start = omp_get_wtime();
 
-	/*Set the values of the destination image to those of the source image.*/
-	setDstToSource(srcData3D, dstData3D);
+	singlePassLabelingDefault(&srcVol, &dstVol, connectivity, NULL);
 
-	singlePassLabelingDefault(dstData3D);
+	/*parallelEdgeFirstSinglePassLabeling(&srcVol, &dstVol, connectivity, NULL);*/
+
+	/*End clocking*/
+	end = omp_get_wtime();
+	printf("Labeling the image took %f seconds to complete\n\n", end - start);
+
+	/*Start clocking*/
+	start = omp_get_wtime();
+
+	/*singlePassLabelingDefault(&srcVol, &dstVol, connectivity, NULL);*/
+
+	parallelEdgeFirstSinglePassLabeling(&srcVol, &dstVol, connectivity, NULL);
+
+	/*End clocking*/
+	end = omp_get_wtime();
+	printf("Labeling the image took %f seconds to complete\n\n", end - start);
+
+	/*Start clocking*/
+	start = omp_get_wtime();
+
+	singlePassLabelingDefault(&srcVol, &dstVol, connectivity, NULL);
+
+	/*parallelEdgeFirstSinglePassLabeling(&srcVol, &dstVol, connectivity, NULL);*/
+
+	/*End clocking*/
+	end = omp_get_wtime();
+	printf("Labeling the image took %f seconds to complete\n\n", end - start);
+
+	/*Start clocking*/
+	start = omp_get_wtime();
+
+	blockUnionFindLabelingDefault(&srcVol, &dstVol, connectivity, NULL);
+
+	/*End clocking*/
+	end = omp_get_wtime();
+	printf("Labeling the image took %f seconds to complete\n\n", end - start);
+
+	/*Start clocking*/
+	start = omp_get_wtime();
+
+	singlePassLabelingSpan(&srcVol, &dstVol, connectivity, NULL);
+
+	/*End clocking*/
+	end = omp_get_wtime();
+	printf("Labeling the image took %f seconds to complete\n\n", end - start);
+
+	/*Start clocking*/
+	start = omp_get_wtime();
+
+	runLengthLabeling(&srcVol, &dstVol, connectivity, &stats);
+
+	/*End clocking*/
+	end = omp_get_wtime();
+	printf("Labeling the image took %f seconds to complete\n\n", end - start);
+	printObjectStats(&stats, 10);
+	freeObjectStats(&stats);
+	printf("\n");
+
+	/*Start clocking*/
+	start = omp_get_wtime();
 
-	/*parallelEdgeFirstSinglePassLabeling(dstData3D);*/
+	/*Label straight from the source into labels as narrow as the objects allow.*/
+	runLengthLabelingPromote(&srcVol, &labelVol, connectivity, NULL);
 
 	/*End clocking*/
-	end = clock();
-	seconds = (float)(end - start) / CLOCKS_PER_SEC;
-	printf("Labeling the image took %f seconds to complete\n\n", seconds);
+	end = omp_get_wtime();
+	printf("Labeling the image into %zu-bit labels took %f seconds to complete\n\n", 8 * labelVol.elemSize, end - start);
+	freeVolume(&labelVol);
 
-	freeImages(srcData3D, dstData3D);
+	freeImages(&srcVol, &dstVol);
 	printf("Done.\n");
 	printf("Press enter to continue...\n");
 	getchar();
 	return 0;
 }
+#endif
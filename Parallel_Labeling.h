@@ -0,0 +1,164 @@
+/*
+  Library interface of Parallel_Labeling.c.
+  Parallel_Labeling.h (C) 2018 by:
+  Scientific Volume Imaging Holding B.V.
+  Laapersveld 63,
+  1213 VB Hilversum,
+  The Netherlands,
+  email: info@svi.nl
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Compile Parallel_Labeling.c with -DPARALLEL_LABELING_LIBRARY to leave out
+   its main, and link the result, as buildLibrary.sh does, to label images
+   from another program. Programs using the library must be compiled with
+   the same LABEL_BITS as the library. */
+#ifndef PARALLEL_LABELING_H
+#define PARALLEL_LABELING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+   /* Define a C data type "SizeType" that is a signed integer with the same
+	  number of bits as a pointer: it is suitable for array indexing up to any
+	  size that fits in memory. The format string for "ptrdiff_t" is "%td". */
+typedef ptrdiff_t               SizeType;
+
+/* Define the pixel data types of the source and destination images. The
+   destination holds labels, and its width is chosen at compile time with
+   LABEL_BITS: 16 bits halves the memory of 32-bit labels, but only holds
+   65533 objects. Compile with -DLABEL_BITS=32 or 64 for more. Labels are
+   not widened when there are more objects than that: the entry points of
+   the library fail with LABELING_ERROR_LABELS. Only the run-length engine of
+   the command line program, runLengthLabelingPromote, picks a wider label
+   type when it needs one. */
+#ifndef LABEL_BITS
+#define LABEL_BITS 16
+#endif
+typedef unsigned char           srcPixelType;
+#if LABEL_BITS == 16
+typedef unsigned short int      dstPixelType;
+#define DST_PIXEL_MAX           ((SizeType)USHRT_MAX)
+#elif LABEL_BITS == 32
+typedef uint32_t                dstPixelType;
+#define DST_PIXEL_MAX           ((SizeType)UINT32_MAX)
+#elif LABEL_BITS == 64
+typedef uint64_t                dstPixelType;
+#define DST_PIXEL_MAX           ((SizeType)PTRDIFF_MAX)
+#else
+#error "LABEL_BITS must be 16, 32 or 64"
+#endif
+
+/* The library exports only the functions declared below; buildLibrary.sh
+   compiles everything else with hidden visibility. */
+#if defined(__GNUC__)
+#define PARALLEL_LABELING_API __attribute__((visibility("default")))
+#else
+#define PARALLEL_LABELING_API
+#endif
+
+#define MAX_NEIGHBORS 26 /*Neighbors of a voxel with the largest supported connectivity; neighbor count histograms have MAX_NEIGHBORS + 1 bins.*/
+
+/* Statistics of all objects of a labeled image as a structure of arrays,
+   entry n describing the object labeled n + 2. The bounding box of an object
+   is [iMin, iMax] x [jMin, jMax] x [kMin, kMax], inclusive, and its centroid
+   the mean coordinate of its voxels. */
+struct ObjectStats {
+	SizeType  objectCount, capacity;
+	SizeType *voxelCount;
+	SizeType *iMin, *iMax, *jMin, *jMax, *kMin, *kMax;
+	double   *iCentroid, *jCentroid, *kCentroid;
+};
+
+/* The labels an incremental relabeling changed. Every voxel whose label
+   changed had one of the removed labels before, has one of the added labels
+   now, or both; removed labels that were not added again are no longer in
+   use. */
+struct LabelChanges {
+	SizeType  removedCount, removedCapacity;
+	SizeType  addedCount, addedCapacity;
+	SizeType *removed, *added;
+};
+
+/* Everything a labeling call needs besides the image: the label image, the
+   equivalence tables, the object statistics and the neighbor histograms.
+   The memory of a workspace is kept from call to call and only reallocated
+   when a call needs more of it than any call before, so labeling a stream of
+   images of similar size allocates nothing after the first. A workspace may
+   be used by one call at a time; give every calling thread its own. The
+   threads labeling for a workspace also keep work stacks of their own from
+   call to call; destroyLabelingWorkspace frees those of the threads it runs
+   on, the calling thread and the OpenMP threads it starts. */
+struct LabelingWorkspace;
+
+/* Return a new workspace, or NULL when memory runs out. */
+PARALLEL_LABELING_API struct LabelingWorkspace *createLabelingWorkspace(void);
+PARALLEL_LABELING_API void destroyLabelingWorkspace(struct LabelingWorkspace *workspace);
+
+/* The entry points below never exit the program. They report failures by
+   returning one of these codes, which are negative, instead of a count. */
+#define LABELING_ERROR_MEMORY   ((SizeType)-1) /*Memory ran out.*/
+#define LABELING_ERROR_ARGUMENT ((SizeType)-2) /*Invalid dimensions, connectivity or changed voxels, or relabelImage without a labeled image.*/
+#define LABELING_ERROR_LABELS   ((SizeType)-3) /*More objects than dstPixelType holds labels for.*/
+
+/* The entry points below take an image of dimX * dimY * dimZ voxels, X
+   fastest, nonzero for object voxels, and a connectivity of 6, 18 or 26. */
+
+/* Label the objects of image with 2, 3, and so on, and return their number.
+   *labels is set to the labels, laid out like image, which stay valid until
+   the next call on workspace. Labels never wrap around: if there are more
+   objects than dstPixelType holds labels for, LABELING_ERROR_LABELS is
+   returned, and the library must be built with a larger LABEL_BITS. On
+   failure *labels is not set, and relabelImage needs a new labeling. */
+PARALLEL_LABELING_API SizeType labelImage(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, const dstPixelType **labels);
+
+/* labelImage that also sets *stats to the statistics of the objects, which
+   stay valid until the next call on workspace. */
+PARALLEL_LABELING_API SizeType labelImageStats(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, const dstPixelType **labels, const struct ObjectStats **stats);
+
+/* Update the labels of the last labelImage or labelImageStats call on
+   workspace after the changedCount voxels at the indices changed, i + dimX *
+   (j + dimY * k) for voxel (i, j, k), of its image were toggled; image is
+   the edited image, of the same dimensions, labeled with the same
+   connectivity. Only the objects touching the changed voxels are relabeled,
+   so the work depends on the size of the edit and of those objects, not on
+   the size of the image. Objects that merge or split get labels of the
+   objects they came from first, and labels never used before after that.
+   *labels is set as by labelImage, and *changes to the labels that changed,
+   valid until the next call on workspace. Object statistics of earlier
+   calls are not updated. Return the number of objects relabeled, or an
+   error code. Changed voxels outside the image are rejected before any
+   label changes; after other failures relabelImage needs a new labeling. */
+PARALLEL_LABELING_API SizeType relabelImage(struct LabelingWorkspace *workspace, const srcPixelType *image, const SizeType *changed, SizeType changedCount,
+	const dstPixelType **labels, const struct LabelChanges **changes);
+
+/* Count the voxels of image by their number of object neighbors: sums[n] is
+   the number of voxels with n nonzero neighbors, for n from 0 up to
+   connectivity. Return 0, or an error code. */
+PARALLEL_LABELING_API SizeType countImageNeighbors(struct LabelingWorkspace *workspace, const srcPixelType *image, SizeType dimX, SizeType dimY, SizeType dimZ,
+	int connectivity, SizeType sums[MAX_NEIGHBORS + 1]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,50 @@
+#!/bin/sh
+
+# Shell script to compile the labeling engines of Parallel_Labeling.c into a
+# static and a shared library, declared in Parallel_Labeling.h.
+# buildLibrary.sh (C) 2018 by:
+#   Scientific Volume Imaging Holding B.V.
+#   Laapersveld 63,
+#   1213 VB Hilversum,
+#   The Netherlands,
+#   email: info@svi.nl
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Define the compiler, do medium optimization, enable many warnings, and
+# enable OpenMP. PARALLEL_LABELING_LIBRARY leaves out main. Programs linking
+# the library must be compiled with the same LABEL_BITS, for instance
+# LABEL_BITS=32 ./buildLibrary.sh and -DLABEL_BITS=32. Everything but the
+# functions of Parallel_Labeling.h is compiled with hidden visibility, so
+# neither library exports the internals of the labeling engines.
+
+CC="gcc"
+CFLAGS="-O2 -Wall -Wextra -fopenmp -fPIC -fvisibility=hidden -DPARALLEL_LABELING_LIBRARY -DLABEL_BITS=${LABEL_BITS:-16}"
+SRCNAME="Parallel_Labeling.c"
+OBJNAME="Parallel_Labeling.o"
+STATICNAME="libparallel_labeling.a"
+SHAREDNAME="libparallel_labeling.so"
+
+# Remove the libraries if old versions are still present.
+rm -f $OBJNAME $STATICNAME $SHAREDNAME
+
+# Compile once, then archive the object file and link it as a shared library.
+# In the archive the hidden symbols are made local as well, so that they
+# cannot clash with those of the program linking it.
+$CC $CFLAGS -c -o $OBJNAME $SRCNAME
+if [ -f $OBJNAME ]; then
+    objcopy --localize-hidden $OBJNAME
+    ar rcs $STATICNAME $OBJNAME
+    $CC -shared -fopenmp -o $SHAREDNAME $OBJNAME
+fi
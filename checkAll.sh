@@ -0,0 +1,63 @@
+#!/bin/sh
+
+# Shell script to run the --check of Parallel_Labeling.c over every image
+# pattern, connectivity and label width, with one and with several threads.
+# checkAll.sh (C) 2018 by:
+#   Scientific Volume Imaging Holding B.V.
+#   Laapersveld 63,
+#   1213 VB Hilversum,
+#   The Netherlands,
+#   email: info@svi.nl
+
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+# Define the compiler, do medium optimization, enable many warnings, and
+# enable OpenMP. The odd dimensions leave partial words, vector rows and
+# blocks at the image borders. The exit status is the number of failed runs.
+
+CC="gcc"
+CFLAGS="-O2 -Wall -Wextra -fopenmp"
+SRCNAME="Parallel_Labeling.c"
+EXENAME="./Parallel_Labeling_check"
+SCRATCHNAME="Parallel_Labeling_check.vol"
+DIMS="${DIMS:-61 47 33}"
+FAILED=0
+
+for BITS in 16 32 64; do
+    rm -f $EXENAME
+    $CC -o $EXENAME $CFLAGS -DLABEL_BITS=$BITS $SRCNAME -lm
+    if [ ! -f $EXENAME ]; then
+        echo "LABEL_BITS=$BITS: build failed"
+        FAILED=$((FAILED + 1))
+        continue
+    fi
+    for PATTERN in percolation spheres helices spiral giant; do
+        for CONNECTIVITY in 6 18 26; do
+            for THREADS in 1 3; do
+                if OMP_NUM_THREADS=$THREADS $EXENAME --connectivity $CONNECTIVITY --check \
+                    --generate $PATTERN $DIMS --scratch $SCRATCHNAME > $EXENAME.log 2>&1; then
+                    echo "LABEL_BITS=$BITS $PATTERN connectivity $CONNECTIVITY, $THREADS threads: ok"
+                else
+                    echo "LABEL_BITS=$BITS $PATTERN connectivity $CONNECTIVITY, $THREADS threads: FAILED"
+                    cat $EXENAME.log
+                    FAILED=$((FAILED + 1))
+                fi
+            done
+        done
+    done
+done
+
+rm -f $EXENAME $EXENAME.log $SCRATCHNAME $SCRATCHNAME.labels
+echo "$FAILED runs failed"
+exit $FAILED
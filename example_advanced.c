@@ -190,6 +190,7 @@ void someOutput(const dstPixelType *dstDataPtr)
     reduction(+:sum2) \
     reduction(+:sum3) \
     reduction(+:sum4) \
+    reduction(+:sum5) \
     reduction(+:sum6) 
     
     for (inx = 0; inx < VOLUME; inx++) {